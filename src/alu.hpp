@@ -0,0 +1,264 @@
+#pragma once
+
+#include "common.hpp"
+
+#include "flags.hpp"
+
+#include <bit>
+#include <cstdint>
+
+// Pure ALU operations. Each returns the result alongside the flags it produced and which flags
+// the operation defines, so the runner can merge them into FLAGS without branching per flag.
+
+namespace sim::alu {
+
+struct Result {
+    u16 value;
+    u16 flags;
+    u16 affected;
+};
+
+static constexpr u16 ARITHMETIC_FLAGS =
+    flags::CF | flags::PF | flags::AF | flags::ZF | flags::SF | flags::OF;
+
+[[nodiscard]] constexpr u16 width_mask(bool is_wide) noexcept { return is_wide ? 0xFFFF : 0xFF; }
+[[nodiscard]] constexpr u16 sign_bit(bool is_wide) noexcept { return is_wide ? 0x8000 : 0x80; }
+[[nodiscard]] constexpr unsigned width_bits(bool is_wide) noexcept { return is_wide ? 16 : 8; }
+
+[[nodiscard]] constexpr u16 flag_if(bool condition, flags::Flag f) noexcept {
+    return static_cast<u16>(condition) * f;
+}
+
+// PF only ever looks at the low byte
+[[nodiscard]] constexpr u16 result_flags(u16 value, bool is_wide) noexcept {
+    return flag_if(!(std::popcount(static_cast<u8>(value)) & 1), flags::PF) |
+           flag_if((value & width_mask(is_wide)) == 0, flags::ZF) |
+           flag_if(value & sign_bit(is_wide), flags::SF);
+}
+
+[[nodiscard]] constexpr Result add(u16 a, u16 b, bool carry, bool is_wide) noexcept {
+    const std::uint32_t full = std::uint32_t{a} + b + carry;
+    const u16 value = full & width_mask(is_wide);
+
+    return Result{
+        .value = value,
+        .flags = static_cast<u16>(
+            result_flags(value, is_wide) | flag_if((full >> width_bits(is_wide)) & 1, flags::CF) |
+            flag_if((a ^ b ^ value) & 0x10, flags::AF) |
+            flag_if((a ^ value) & (b ^ value) & sign_bit(is_wide), flags::OF)),
+        .affected = ARITHMETIC_FLAGS,
+    };
+}
+
+[[nodiscard]] constexpr Result sub(u16 a, u16 b, bool borrow, bool is_wide) noexcept {
+    const std::uint32_t full = std::uint32_t{a} - b - borrow;
+    const u16 value = full & width_mask(is_wide);
+
+    return Result{
+        .value = value,
+        .flags = static_cast<u16>(
+            result_flags(value, is_wide) | flag_if((full >> width_bits(is_wide)) & 1, flags::CF) |
+            flag_if((a ^ b ^ value) & 0x10, flags::AF) |
+            flag_if((a ^ b) & (a ^ value) & sign_bit(is_wide), flags::OF)),
+        .affected = ARITHMETIC_FLAGS,
+    };
+}
+
+// AND/OR/XOR/TEST: CF and OF are cleared, AF is undefined (cleared here)
+[[nodiscard]] constexpr Result logic(u16 value, bool is_wide) noexcept {
+    value &= width_mask(is_wide);
+
+    return Result{
+        .value = value,
+        .flags = result_flags(value, is_wide),
+        .affected = ARITHMETIC_FLAGS,
+    };
+}
+
+// NOTE(louis): the 8086 doesn't mask shift counts, so anything past the operand width shifts
+// everything out. Counts are clamped before hitting the host shifter to keep it defined.
+[[nodiscard]] constexpr Result shl(u16 a, u8 count, bool is_wide) noexcept {
+    const std::uint64_t wide = a & width_mask(is_wide);
+    const std::uint64_t shifted = wide << (count > 32 ? 32 : count);
+    const u16 value = shifted & width_mask(is_wide);
+    const bool cf = (shifted >> width_bits(is_wide)) & 1;
+
+    return Result{
+        .value = value,
+        .flags = static_cast<u16>(result_flags(value, is_wide) | flag_if(cf, flags::CF) |
+                                  flag_if(!!(value & sign_bit(is_wide)) != cf, flags::OF)),
+        .affected = ARITHMETIC_FLAGS & ~flags::AF,
+    };
+}
+
+[[nodiscard]] constexpr Result shr(u16 a, u8 count, bool is_wide) noexcept {
+    const std::uint32_t wide = a & width_mask(is_wide);
+    const u16 value = count > 16 ? 0 : wide >> count;
+    const bool cf = count > 17 ? false : (wide >> (count - 1)) & 1;
+
+    return Result{
+        .value = value,
+        .flags = static_cast<u16>(result_flags(value, is_wide) | flag_if(cf, flags::CF) |
+                                  flag_if(a & sign_bit(is_wide), flags::OF)),
+        .affected = ARITHMETIC_FLAGS & ~flags::AF,
+    };
+}
+
+[[nodiscard]] constexpr Result sar(u16 a, u8 count, bool is_wide) noexcept {
+    const std::int32_t sa = is_wide ? static_cast<s16>(a) : static_cast<s8>(a);
+    const u16 value = (sa >> (count > 31 ? 31 : count)) & width_mask(is_wide);
+    const bool cf = (sa >> (count > 32 ? 31 : count - 1)) & 1;
+
+    return Result{
+        .value = value,
+        .flags = static_cast<u16>(result_flags(value, is_wide) | flag_if(cf, flags::CF)),
+        .affected = ARITHMETIC_FLAGS & ~flags::AF,
+    };
+}
+
+// Rotates only touch CF and OF
+[[nodiscard]] constexpr Result rol(u16 a, u8 count, bool is_wide) noexcept {
+    const u16 value = is_wide ? std::rotl(a, count % 16)
+                              : std::rotl(static_cast<u8>(a), count % 8);
+    const bool cf = value & 1;
+
+    return Result{
+        .value = value,
+        .flags = static_cast<u16>(flag_if(cf, flags::CF) |
+                                  flag_if(!!(value & sign_bit(is_wide)) != cf, flags::OF)),
+        .affected = flags::CF | flags::OF,
+    };
+}
+
+[[nodiscard]] constexpr Result ror(u16 a, u8 count, bool is_wide) noexcept {
+    const u16 value = is_wide ? std::rotr(a, count % 16)
+                              : std::rotr(static_cast<u8>(a), count % 8);
+    const bool msb = value & sign_bit(is_wide);
+    const bool next = value & (sign_bit(is_wide) >> 1);
+
+    return Result{
+        .value = value,
+        .flags = static_cast<u16>(flag_if(msb, flags::CF) | flag_if(msb != next, flags::OF)),
+        .affected = flags::CF | flags::OF,
+    };
+}
+
+// RCL/RCR rotate the (width + 1)-bit value CF:a
+[[nodiscard]] constexpr Result rcl(u16 a, u8 count, bool carry, bool is_wide) noexcept {
+    const unsigned bits = width_bits(is_wide) + 1;
+    const unsigned n = count % bits;
+    const std::uint32_t full_mask = (1u << bits) - 1;
+
+    const std::uint32_t x = (std::uint32_t{carry} << (bits - 1)) | (a & width_mask(is_wide));
+    const std::uint32_t rotated = ((x << n) | (x >> (bits - n))) & full_mask;
+
+    const u16 value = rotated & width_mask(is_wide);
+    const bool cf = rotated >> (bits - 1);
+
+    return Result{
+        .value = value,
+        .flags = static_cast<u16>(flag_if(cf, flags::CF) |
+                                  flag_if(!!(value & sign_bit(is_wide)) != cf, flags::OF)),
+        .affected = flags::CF | flags::OF,
+    };
+}
+
+[[nodiscard]] constexpr Result rcr(u16 a, u8 count, bool carry, bool is_wide) noexcept {
+    const unsigned bits = width_bits(is_wide) + 1;
+    const unsigned n = count % bits;
+    const std::uint32_t full_mask = (1u << bits) - 1;
+
+    const std::uint32_t x = (std::uint32_t{carry} << (bits - 1)) | (a & width_mask(is_wide));
+    const std::uint32_t rotated = ((x >> n) | (x << (bits - n))) & full_mask;
+
+    const u16 value = rotated & width_mask(is_wide);
+    const bool msb = value & sign_bit(is_wide);
+    const bool next = value & (sign_bit(is_wide) >> 1);
+
+    return Result{
+        .value = value,
+        .flags = static_cast<u16>(flag_if(rotated >> (bits - 1), flags::CF) |
+                                  flag_if(msb != next, flags::OF)),
+        .affected = flags::CF | flags::OF,
+    };
+}
+
+struct WideResult {
+    u16 low;
+    u16 high;
+    u16 flags;
+    u16 affected;
+};
+
+// MUL/IMUL: CF = OF = the upper half carries significant bits
+[[nodiscard]] constexpr WideResult mul(u16 a, u16 b, bool is_wide) noexcept {
+    const std::uint32_t product =
+        std::uint32_t{static_cast<u16>(a & width_mask(is_wide))} * (b & width_mask(is_wide));
+    const u16 low = product & width_mask(is_wide);
+    const u16 high = (product >> width_bits(is_wide)) & width_mask(is_wide);
+
+    return WideResult{
+        .low = low,
+        .high = high,
+        .flags = static_cast<u16>(flag_if(high != 0, flags::CF) | flag_if(high != 0, flags::OF)),
+        .affected = flags::CF | flags::OF,
+    };
+}
+
+[[nodiscard]] constexpr WideResult imul(u16 a, u16 b, bool is_wide) noexcept {
+    const std::int32_t sa = is_wide ? static_cast<s16>(a) : static_cast<s8>(a);
+    const std::int32_t sb = is_wide ? static_cast<s16>(b) : static_cast<s8>(b);
+    const std::int32_t product = sa * sb;
+
+    const u16 low = product & width_mask(is_wide);
+    const u16 high = (product >> width_bits(is_wide)) & width_mask(is_wide);
+    const std::int32_t truncated = is_wide ? static_cast<s16>(low) : static_cast<s8>(low);
+
+    return WideResult{
+        .low = low,
+        .high = high,
+        .flags = static_cast<u16>(flag_if(truncated != product, flags::CF) |
+                                  flag_if(truncated != product, flags::OF)),
+        .affected = flags::CF | flags::OF,
+    };
+}
+
+// DIV/IDIV leave every flag undefined; overflow (including divide by zero) raises INT 0
+struct DivResult {
+    u16 quotient;
+    u16 remainder;
+    bool overflow;
+};
+
+[[nodiscard]] constexpr DivResult div(std::uint32_t dividend, u16 divisor, bool is_wide) noexcept {
+    divisor &= width_mask(is_wide);
+    if (divisor == 0)
+        return DivResult{0, 0, true};
+
+    const std::uint32_t quotient = dividend / divisor;
+    return DivResult{
+        .quotient = static_cast<u16>(quotient),
+        .remainder = static_cast<u16>(dividend % divisor),
+        .overflow = quotient > width_mask(is_wide),
+    };
+}
+
+[[nodiscard]] constexpr DivResult idiv(std::uint32_t dividend, u16 divisor, bool is_wide) noexcept {
+    const std::int64_t sdividend =
+        is_wide ? static_cast<std::int32_t>(dividend) : static_cast<s16>(dividend);
+    const std::int64_t sdivisor = is_wide ? static_cast<s16>(divisor) : static_cast<s8>(divisor);
+    if (sdivisor == 0)
+        return DivResult{0, 0, true};
+
+    // NOTE(louis): the 8086 faults on the most negative quotient too, unlike later CPUs
+    const std::int64_t quotient = sdividend / sdivisor;
+    const std::int64_t limit = is_wide ? 0x7FFF : 0x7F;
+
+    return DivResult{
+        .quotient = static_cast<u16>(quotient),
+        .remainder = static_cast<u16>(sdividend % sdivisor),
+        .overflow = quotient > limit || quotient < -limit,
+    };
+}
+
+} // namespace sim::alu
@@ -0,0 +1,112 @@
+#include "common.hpp"
+
+#include "bus.hpp"
+
+#include <algorithm>
+
+namespace sim::bus {
+
+PageTable::PageTable(std::span<u8> memory) noexcept {
+    const std::size_t pages = std::min<std::size_t>(memory.size() / PAGE_SIZE, PAGES);
+    for (std::size_t page = 0; page < pages; page++)
+        ram[page] = memory.data() + page * PAGE_SIZE;
+}
+
+bool PageTable::map(std::uint32_t base, std::uint32_t size, MemoryDevice &device) noexcept {
+    if (base % PAGE_SIZE != 0 || size % PAGE_SIZE != 0 || base + size > ADDRESS_SPACE)
+        return false;
+
+    for (std::uint32_t page = base / PAGE_SIZE; page < (base + size) / PAGE_SIZE; page++) {
+        ram[page] = nullptr;
+        devices[page] = &device;
+    }
+    return true;
+}
+
+bool PageTable::is_ram(std::uint32_t address, std::size_t size) const noexcept {
+    if (size == 0)
+        return true;
+    if (address + size > ADDRESS_SPACE)
+        return false;
+
+    const std::size_t last = (address + size - 1) >> PAGE_BITS;
+    for (std::size_t page = address >> PAGE_BITS; page <= last; page++) {
+        if (!ram[page])
+            return false;
+    }
+    return true;
+}
+
+u8 PageTable::read_device(std::uint32_t address) noexcept {
+    MemoryDevice *device = devices[address >> PAGE_BITS];
+    return device ? device->read(address) : 0xFF;
+}
+
+void PageTable::write_device(std::uint32_t address, u8 value) noexcept {
+    if (MemoryDevice *device = devices[address >> PAGE_BITS])
+        device->write(address, value);
+}
+
+void Bus::map_ports(u16 first, u16 last, io::Device &device) noexcept {
+    ports.push_back(Range{first, last, &device});
+}
+
+void Bus::attach_clock(Clocked &clock) noexcept {
+    clocks.push_back(&clock);
+    deadline = 0;
+}
+
+io::Device *Bus::find(u16 port) const noexcept {
+    // NOTE(louis): a handful of ranges, and only IN/OUT get here
+    for (const auto &range : ports) {
+        if (port >= range.first && port <= range.last)
+            return range.device;
+    }
+    return nullptr;
+}
+
+void Bus::advance(io::Time now) noexcept {
+    deadline = NEVER;
+    for (Clocked *clock : clocks)
+        deadline = std::min(deadline, clock->advance(now));
+}
+
+u16 Bus::in(u16 port, bool is_wide, io::Time now) noexcept {
+    if (now.cycles >= deadline)
+        advance(now);
+
+    io::Device *device = find(port);
+    if (!device)
+        return is_wide ? 0xFFFF : 0xFF;
+    return device->in(port, is_wide, now);
+}
+
+void Bus::out(u16 port, u16 value, bool is_wide, io::Time now) noexcept {
+    if (now.cycles >= deadline)
+        advance(now);
+
+    if (io::Device *device = find(port)) {
+        device->out(port, value, is_wide, now);
+
+        // it may have been reprogrammed, ask again next time
+        deadline = clocks.empty() ? NEVER : 0;
+    }
+}
+
+std::optional<u8> Bus::interrupt(io::Time now) noexcept {
+    if (now.cycles >= deadline)
+        advance(now);
+
+    return pic ? pic->interrupt(now) : std::nullopt;
+}
+
+std::uint64_t Bus::wake(io::Time now) noexcept {
+    if (now.cycles >= deadline)
+        advance(now);
+
+    // NOTE(louis): interrupts only ever come from clocked devices, so the next of their events is
+    // the earliest one could
+    return pic ? deadline : NEVER;
+}
+
+} // namespace sim::bus
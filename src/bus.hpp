@@ -0,0 +1,106 @@
+#pragma once
+
+#include "common.hpp"
+
+#include "io.hpp"
+
+#include <array>
+#include <cstdint>
+#include <optional>
+#include <span>
+#include <vector>
+
+// Where guest memory and port accesses end up. Memory goes through a page table so RAM is one
+// lookup away and only pages a device claimed take the slow path; ports go to whichever device
+// registered the range.
+
+namespace sim::bus {
+
+// Something mapped into the memory address space, called for every byte accessed on its pages
+class MemoryDevice {
+public:
+    virtual ~MemoryDevice() = default;
+
+    [[nodiscard]] virtual u8 read(std::uint32_t address) noexcept = 0;
+    virtual void write(std::uint32_t address, u8 value) noexcept = 0;
+};
+
+class PageTable {
+public:
+    static constexpr std::uint32_t PAGE_BITS = 12;
+    static constexpr std::uint32_t PAGE_SIZE = 1 << PAGE_BITS;
+    static constexpr std::uint32_t ADDRESS_SPACE = 1 << 20;
+    static constexpr std::uint32_t PAGES = ADDRESS_SPACE / PAGE_SIZE;
+
+    // Every page ram covers starts out as RAM; anything past it reads as all ones
+    explicit PageTable(std::span<u8> ram) noexcept;
+
+    // base and size have to be page aligned
+    bool map(std::uint32_t base, std::uint32_t size, MemoryDevice &device) noexcept;
+
+    [[nodiscard]] u8 read(std::uint32_t address) noexcept {
+        address &= ADDRESS_SPACE - 1;
+        if (u8 *page = ram[address >> PAGE_BITS])
+            return page[address & (PAGE_SIZE - 1)];
+        return read_device(address);
+    }
+
+    void write(std::uint32_t address, u8 value) noexcept {
+        address &= ADDRESS_SPACE - 1;
+        if (u8 *page = ram[address >> PAGE_BITS])
+            page[address & (PAGE_SIZE - 1)] = value;
+        else
+            write_device(address, value);
+    }
+
+    // true when all of [address, address + size) is RAM, so it can be touched directly
+    [[nodiscard]] bool is_ram(std::uint32_t address, std::size_t size) const noexcept;
+
+private:
+    std::array<u8 *, PAGES> ram = {};
+    std::array<MemoryDevice *, PAGES> devices = {};
+
+    [[nodiscard]] u8 read_device(std::uint32_t address) noexcept;
+    void write_device(std::uint32_t address, u8 value) noexcept;
+};
+
+// Devices whose state moves with guest time. They're only advanced once the cycle count reaches
+// the deadline they last returned, so idle ones cost a compare per instruction.
+class Clocked {
+public:
+    virtual ~Clocked() = default;
+
+    // Catches up to now and returns the cycle count of the next thing that will happen
+    [[nodiscard]] virtual std::uint64_t advance(io::Time now) noexcept = 0;
+};
+
+class Bus final : public io::Device {
+public:
+    static constexpr std::uint64_t NEVER = io::NEVER;
+
+    void map_ports(u16 first, u16 last, io::Device &device) noexcept;
+    void attach_clock(Clocked &clock) noexcept;
+    void attach_interrupt_controller(io::Device &controller) noexcept { pic = &controller; }
+
+    [[nodiscard]] u16 in(u16 port, bool is_wide, io::Time now) noexcept override;
+    void out(u16 port, u16 value, bool is_wide, io::Time now) noexcept override;
+    [[nodiscard]] std::optional<u8> interrupt(io::Time now) noexcept override;
+    [[nodiscard]] std::uint64_t wake(io::Time now) noexcept override;
+
+private:
+    struct Range {
+        u16 first;
+        u16 last;
+        io::Device *device;
+    };
+
+    std::vector<Range> ports;
+    std::vector<Clocked *> clocks;
+    io::Device *pic = nullptr;
+    std::uint64_t deadline = NEVER;
+
+    [[nodiscard]] io::Device *find(u16 port) const noexcept;
+    void advance(io::Time now) noexcept;
+};
+
+} // namespace sim::bus
@@ -0,0 +1,572 @@
+#include "common.hpp"
+
+#include "alu.hpp"
+#include "cfg.hpp"
+#include "decode.hpp"
+#include "flags.hpp"
+#include "registers.hpp"
+
+#include <algorithm>
+#include <cstdint>
+#include <iomanip>
+#include <optional>
+#include <sstream>
+
+namespace sim::cfg {
+
+namespace {
+    using instructions::Instruction;
+    using instructions::Mnemonic;
+    using instructions::Operand;
+
+    // what an unknown successor might read
+    constexpr Liveness EVERYTHING{alu::ARITHMETIC_FLAGS, 0xFF};
+
+    constexpr u8 bit(u8 reg) noexcept { return static_cast<u8>(1 << reg); }
+
+    // Registers an operand reads to get at its value, or its address if it's memory
+    [[nodiscard]] constexpr u8 address_registers(const Operand &operand) noexcept {
+        if (operand.type != Operand::Type::MEMORY)
+            return 0;
+
+        u8 registers = 0;
+        for (const auto &term : operand.mem_access.terms) {
+            if (term.index != registers::NONE)
+                registers |= bit(term.index);
+        }
+        return registers;
+    }
+
+    [[nodiscard]] constexpr u8 value_registers(const Operand &operand) noexcept {
+        if (operand.type == Operand::Type::REGISTER)
+            return bit(operand.reg_access.index & (operand.reg_access.is_wide ? 0b111 : 0b011));
+        return address_registers(operand);
+    }
+
+    // A byte write leaves the other half of the register as it was
+    [[nodiscard]] constexpr u8 replaced_registers(const Operand &operand) noexcept {
+        if (operand.type == Operand::Type::REGISTER && operand.reg_access.is_wide)
+            return bit(operand.reg_access.index);
+        return 0;
+    }
+
+    [[nodiscard]] constexpr u16 condition_flags(Mnemonic mnemonic) noexcept {
+        using namespace flags;
+
+        switch (mnemonic) {
+        case Mnemonic::JE:
+        case Mnemonic::JNE:
+        case Mnemonic::LOOPZ:
+        case Mnemonic::LOOPNZ:
+            return ZF;
+        case Mnemonic::JL:
+        case Mnemonic::JNL:
+            return SF | OF;
+        case Mnemonic::JLE:
+        case Mnemonic::JG:
+            return ZF | SF | OF;
+        case Mnemonic::JB:
+        case Mnemonic::JNB:
+            return CF;
+        case Mnemonic::JBE:
+        case Mnemonic::JA:
+            return CF | ZF;
+        case Mnemonic::JP:
+        case Mnemonic::JNP:
+            return PF;
+        case Mnemonic::JO:
+        case Mnemonic::JNO:
+            return OF;
+        case Mnemonic::JS:
+        case Mnemonic::JNS:
+            return SF;
+        default:
+            return 0;
+        }
+    }
+
+    // Where control can go after inst, which ends at next
+    struct Flow {
+        std::optional<u16> target;
+        bool falls_through;
+        bool leaves = false; // to somewhere only known at run time
+    };
+
+    [[nodiscard]] Flow flow(const Instruction &inst, u16 next) noexcept {
+        const bool relative = inst.dst.type == Operand::Type::RELATIVE;
+        const u16 target = next + inst.dst.immediate;
+
+        if (inst.mnemonic >= Mnemonic::JE && inst.mnemonic <= Mnemonic::JCXZ)
+            return {target, true};
+
+        switch (inst.mnemonic) {
+        case Mnemonic::JMP:
+            return relative ? Flow{target, false} : Flow{std::nullopt, false, true};
+        case Mnemonic::CALL:
+            // NOTE(louis): calls are assumed to come back, the return itself leaves the graph
+            return relative ? Flow{target, true} : Flow{std::nullopt, true, true};
+        case Mnemonic::RET:
+        case Mnemonic::IRET:
+            return {std::nullopt, false, true};
+        default:
+            return {std::nullopt, true};
+        }
+    }
+
+    [[nodiscard]] constexpr Liveness transfer(const Effect &effect, Liveness live) noexcept {
+        if (effect.leaves) {
+            live.flags |= EVERYTHING.flags;
+            live.registers |= EVERYTHING.registers;
+        }
+
+        live.flags = (live.flags & ~effect.writes.flags) | effect.reads.flags;
+        live.registers = (live.registers & ~effect.writes.registers) | effect.reads.registers;
+        return live;
+    }
+
+    void escape(std::ostream &out, std::string_view text) noexcept {
+        for (const char c : text) {
+            if (c == '"' || c == '\\')
+                out << '\\';
+            out << c;
+        }
+    }
+
+    void write_liveness(std::ostream &out, const Liveness &live) noexcept {
+        for (u8 reg = 0; reg < registers::REG_NAMES.size(); reg++) {
+            if (live.registers & bit(reg))
+                out << ' ' << registers::REG_NAMES[reg];
+        }
+        for (const auto &[flag, name] : flags::FLAG_NAMES) {
+            if (live.flags & flag)
+                out << ' ' << name;
+        }
+    }
+} // namespace
+
+u16 flags_read(const Instruction &inst) noexcept {
+    using namespace flags;
+
+    switch (inst.mnemonic) {
+    case Mnemonic::ADC:
+    case Mnemonic::SBB:
+    case Mnemonic::RCL:
+    case Mnemonic::RCR:
+    case Mnemonic::CMC:
+        return CF;
+
+    // PUSHF and interrupts copy the flags out, a divide can fault into one and a hlt waits for one
+    case Mnemonic::PUSHF:
+    case Mnemonic::INT:
+    case Mnemonic::INT3:
+    case Mnemonic::INTO:
+    case Mnemonic::HLT:
+    case Mnemonic::DIV:
+    case Mnemonic::IDIV:
+        return alu::ARITHMETIC_FLAGS;
+
+    default:
+        return condition_flags(inst.mnemonic);
+    }
+}
+
+Effect effect(const Instruction &inst) noexcept {
+    using namespace flags;
+    using alu::ARITHMETIC_FLAGS;
+
+    const u8 ax = bit(registers::AX);
+    const u8 cx = bit(registers::CX);
+    const u8 dx = bit(registers::DX);
+    const u8 sp = bit(registers::SP);
+    const u8 si = bit(registers::SI);
+    const u8 di = bit(registers::DI);
+
+    const u8 dst = value_registers(inst.dst);
+    const u8 src = value_registers(inst.src);
+    const u8 dst_address = address_registers(inst.dst);
+    const u8 replaced = replaced_registers(inst.dst);
+    const bool repeated = inst.prefix != instructions::Prefix::NONE;
+
+    Effect e;
+    e.reads.flags = flags_read(inst);
+    switch (inst.mnemonic) {
+    case Mnemonic::MOV:
+        e.reads.registers = src | dst_address;
+        e.writes.registers = replaced;
+        break;
+
+    case Mnemonic::LEA:
+        e.reads.registers = src;
+        e.writes.registers = replaced;
+        break;
+
+    case Mnemonic::ADD:
+    case Mnemonic::SUB:
+    case Mnemonic::AND:
+    case Mnemonic::OR:
+    case Mnemonic::XOR:
+        e.reads.registers = dst | src;
+        e.writes = {ARITHMETIC_FLAGS, replaced};
+        break;
+
+    case Mnemonic::ADC:
+    case Mnemonic::SBB:
+        e.reads.registers = dst | src;
+        e.writes = {ARITHMETIC_FLAGS, replaced};
+        break;
+
+    case Mnemonic::CMP:
+    case Mnemonic::TEST:
+        e.reads.registers = dst | src;
+        e.writes.flags = ARITHMETIC_FLAGS;
+        break;
+
+    case Mnemonic::NEG:
+        e.reads.registers = dst;
+        e.writes = {ARITHMETIC_FLAGS, replaced};
+        break;
+
+    case Mnemonic::INC:
+    case Mnemonic::DEC:
+        e.reads.registers = dst;
+        e.writes = {static_cast<u16>(ARITHMETIC_FLAGS & ~CF), replaced};
+        break;
+
+    case Mnemonic::NOT:
+        e.reads.registers = dst;
+        e.writes.registers = replaced;
+        break;
+
+    case Mnemonic::SHL:
+    case Mnemonic::SHR:
+    case Mnemonic::SAR:
+    case Mnemonic::ROL:
+    case Mnemonic::ROR:
+    case Mnemonic::RCL:
+    case Mnemonic::RCR: {
+        e.reads.registers = dst | src;
+        e.writes.registers = replaced;
+
+        const bool rotate = inst.mnemonic >= Mnemonic::ROL;
+        // a count of zero in cl changes nothing, flags included
+        if (inst.src.type == Operand::Type::IMMEDIATE)
+            e.writes.flags = rotate ? CF | OF : ARITHMETIC_FLAGS & ~AF;
+        break;
+    }
+
+    case Mnemonic::MUL:
+    case Mnemonic::IMUL:
+        e.reads.registers = ax | dst;
+        e.writes = {CF | OF, static_cast<u8>(inst.dst.is_wide() ? ax | dx : ax)};
+        break;
+
+    case Mnemonic::DIV:
+    case Mnemonic::IDIV:
+        // NOTE(louis): nothing is written for sure since a fault leaves everything as it was
+        e.reads.registers = ax | dst | (inst.dst.is_wide() ? dx : 0);
+        e.leaves = true;
+        break;
+
+    case Mnemonic::XCHG:
+        e.reads.registers = dst | src;
+        e.writes.registers = replaced | replaced_registers(inst.src);
+        break;
+
+    case Mnemonic::CBW:
+        e.reads.registers = ax;
+        e.writes.registers = ax;
+        break;
+
+    case Mnemonic::CWD:
+        e.reads.registers = ax;
+        e.writes.registers = dx;
+        break;
+
+    case Mnemonic::PUSH:
+        e.reads.registers = sp | dst;
+        e.writes.registers = sp;
+        break;
+
+    case Mnemonic::POP:
+        e.reads.registers = sp | dst_address;
+        e.writes.registers = sp | replaced;
+        break;
+
+    case Mnemonic::PUSHF:
+        e.reads.registers = sp;
+        e.writes.registers = sp;
+        break;
+
+    case Mnemonic::POPF:
+        e.reads.registers = sp;
+        e.writes = {ARITHMETIC_FLAGS, sp};
+        break;
+
+    case Mnemonic::CALL:
+    case Mnemonic::RET:
+        e.reads.registers = sp | dst;
+        e.writes.registers = sp;
+        break;
+
+    case Mnemonic::JMP:
+        e.reads.registers = dst;
+        break;
+
+    case Mnemonic::INT:
+    case Mnemonic::INT3:
+    case Mnemonic::INTO:
+    case Mnemonic::HLT: // whatever wakes it
+        e.reads.registers = sp;
+        e.leaves = true;
+        break;
+
+    case Mnemonic::IRET:
+        e.reads.registers = sp;
+        e.writes = {ARITHMETIC_FLAGS, sp};
+        break;
+
+    case Mnemonic::LOOP:
+    case Mnemonic::LOOPZ:
+    case Mnemonic::LOOPNZ:
+        e.reads.registers = cx;
+        e.writes.registers = cx;
+        break;
+
+    case Mnemonic::JCXZ:
+        e.reads.registers = cx;
+        break;
+
+    case Mnemonic::MOVSB:
+    case Mnemonic::MOVSW:
+    case Mnemonic::CMPSB:
+    case Mnemonic::CMPSW:
+    case Mnemonic::SCASB:
+    case Mnemonic::SCASW:
+    case Mnemonic::LODSB:
+    case Mnemonic::LODSW:
+    case Mnemonic::STOSB:
+    case Mnemonic::STOSW: {
+        const bool source = inst.mnemonic <= Mnemonic::CMPSW || inst.mnemonic == Mnemonic::LODSB ||
+                            inst.mnemonic == Mnemonic::LODSW;
+        const bool dest = inst.mnemonic <= Mnemonic::SCASW || inst.mnemonic >= Mnemonic::STOSB;
+        const bool compares = inst.mnemonic >= Mnemonic::CMPSB && inst.mnemonic <= Mnemonic::SCASW;
+        const bool uses_acc = inst.mnemonic == Mnemonic::SCASB ||
+                              inst.mnemonic == Mnemonic::SCASW ||
+                              inst.mnemonic >= Mnemonic::STOSB;
+
+        const u8 pointers = (source ? si : 0) | (dest ? di : 0);
+        e.reads.registers = pointers | (uses_acc ? ax : 0) | (repeated ? cx : 0);
+
+        // with a rep prefix and cx at zero nothing happens at all
+        if (!repeated) {
+            e.writes.registers = pointers | (inst.mnemonic == Mnemonic::LODSW ? ax : 0);
+            e.writes.flags = compares ? ARITHMETIC_FLAGS : 0;
+        }
+        break;
+    }
+
+    case Mnemonic::IN:
+        e.reads.registers = src;
+        e.writes.registers = replaced;
+        break;
+
+    case Mnemonic::OUT:
+        e.reads.registers = dst | src;
+        break;
+
+    case Mnemonic::CLC:
+    case Mnemonic::STC:
+        e.writes.flags = CF;
+        break;
+
+    case Mnemonic::CMC:
+        e.writes.flags = CF;
+        break;
+
+    default:
+        break;
+    }
+
+    return e;
+}
+
+Graph Graph::build(std::span<const u8> memory, std::size_t image_size, u16 entry) noexcept {
+    const std::size_t size = std::min({image_size, memory.size(), std::size_t{0x10000}});
+
+    // every reachable instruction, by address
+    std::vector<Instruction> decoded;
+    std::vector<std::int32_t> decoded_at(size, -1);
+    std::vector<bool> leader(size, false);
+
+    auto decode_at = [&](std::size_t address) -> const Instruction * {
+        if (address >= size)
+            return nullptr;
+        if (decoded_at[address] == -1) {
+            auto inst = decode::try_decode(memory.first(size), address);
+            if (!inst)
+                return nullptr;
+            decoded_at[address] = decoded.size();
+            decoded.push_back(std::move(*inst));
+        }
+        return &decoded[decoded_at[address]];
+    };
+
+    std::vector<u16> worklist;
+    if (decode_at(entry)) {
+        leader[entry] = true;
+        worklist.push_back(entry);
+    }
+
+    std::vector<bool> visited(size, false);
+    while (!worklist.empty()) {
+        u16 address = worklist.back();
+        worklist.pop_back();
+
+        // walk straight-line code until something branches
+        while (!visited[address]) {
+            visited[address] = true;
+            const Instruction inst = *decode_at(address);
+            const u16 next = address + inst.bytes.size();
+            const Flow f = flow(inst, next);
+
+            if (f.target && decode_at(*f.target)) {
+                leader[*f.target] = true;
+                worklist.push_back(*f.target);
+            }
+
+            if (!f.falls_through || !decode_at(next))
+                break;
+
+            if (instructions::ends_block(inst.mnemonic)) {
+                leader[next] = true;
+                worklist.push_back(next);
+                break;
+            }
+            address = next;
+        }
+    }
+
+    Graph graph;
+    graph.dead.assign(size, 0);
+
+    std::vector<std::int32_t> block_at(size, -1);
+    for (std::size_t address = 0; address < size; address++) {
+        if (leader[address]) {
+            block_at[address] = graph.blocks.size();
+            graph.blocks.emplace_back().start = address;
+        }
+    }
+
+    for (Block &block : graph.blocks) {
+        u16 address = block.start;
+        for (;;) {
+            const Instruction &inst = decoded[decoded_at[address]];
+            block.instructions.push_back(inst);
+
+            const u16 next = address + inst.bytes.size();
+            const Flow f = flow(inst, next);
+
+            // NOTE(louis): stopping for a bad decode or running off the end is observable too
+            const bool ends = instructions::ends_block(inst.mnemonic) || !f.falls_through ||
+                              next >= size || decoded_at[next] == -1 || leader[next];
+            if (!ends) {
+                address = next;
+                continue;
+            }
+
+            auto edge = [&](u16 to) {
+                if (to < size && block_at[to] != -1)
+                    block.successors.push_back(block_at[to]);
+                else
+                    block.leaves = true;
+            };
+
+            if (f.target)
+                edge(*f.target);
+            if (f.falls_through)
+                edge(next);
+            block.leaves |= f.leaves;
+            break;
+        }
+
+        std::sort(block.successors.begin(), block.successors.end());
+        block.successors.erase(std::unique(block.successors.begin(), block.successors.end()),
+                               block.successors.end());
+    }
+
+    // backwards dataflow to a fixed point, latest blocks first since most edges go forwards
+    for (bool changed = true; changed;) {
+        changed = false;
+
+        for (auto it = graph.blocks.rbegin(); it != graph.blocks.rend(); ++it) {
+            Block &block = *it;
+
+            Liveness live = block.leaves ? EVERYTHING : Liveness{};
+            for (const std::size_t successor : block.successors) {
+                live.flags |= graph.blocks[successor].live_in.flags;
+                live.registers |= graph.blocks[successor].live_in.registers;
+            }
+            block.live_out = live;
+
+            for (auto inst = block.instructions.rbegin(); inst != block.instructions.rend(); ++inst)
+                live = transfer(effect(*inst), live);
+
+            if (live != block.live_in) {
+                block.live_in = live;
+                changed = true;
+            }
+        }
+    }
+
+    for (const Block &block : graph.blocks) {
+        Liveness live = block.live_out;
+        for (auto inst = block.instructions.rbegin(); inst != block.instructions.rend(); ++inst) {
+            const Effect e = effect(*inst);
+            const Liveness after = e.leaves ? EVERYTHING : live;
+            graph.dead[inst->address] = e.writes.flags & ~after.flags;
+            live = transfer(e, live);
+        }
+    }
+
+    return graph;
+}
+
+std::string Graph::dot() const noexcept {
+    std::stringstream out;
+    out << std::hex << std::setfill('0');
+
+    out << "digraph cfg {\n";
+    out << "    node [shape=box fontname=monospace];\n";
+
+    bool any_leave = false;
+    for (const Block &block : blocks) {
+        out << "    b" << std::setw(4) << block.start << " [label=\"" << std::setw(4)
+            << block.start << ":\\l";
+        for (const Instruction &inst : block.instructions) {
+            out << "    ";
+            escape(out, Instruction::assembly(inst));
+            out << "\\l";
+        }
+        out << "live in:";
+        write_liveness(out, block.live_in);
+        out << "\\l\"];\n";
+
+        for (const std::size_t successor : block.successors) {
+            out << "    b" << std::setw(4) << block.start << " -> b" << std::setw(4)
+                << blocks[successor].start << ";\n";
+        }
+
+        if (block.leaves) {
+            out << "    b" << std::setw(4) << block.start << " -> elsewhere [style=dashed];\n";
+            any_leave = true;
+        }
+    }
+
+    if (any_leave)
+        out << "    elsewhere [shape=plaintext label=\"?\"];\n";
+
+    out << "}\n";
+    return out.str();
+}
+
+} // namespace sim::cfg
@@ -0,0 +1,71 @@
+#pragma once
+
+#include "common.hpp"
+
+#include "instructions.hpp"
+
+#include <cstddef>
+#include <span>
+#include <string>
+#include <vector>
+
+// Static control flow graph of a guest program, with liveness of the arithmetic flags and the
+// general registers. Only relative jumps and calls are followed; returns, indirect jumps and
+// interrupts leave the graph, so everything is assumed live wherever they go.
+
+namespace sim::cfg {
+
+// Sets of flags (FLAGS bit positions) and word registers (bit n is register n, ax = bit 0)
+struct Liveness {
+    u16 flags = 0;
+    u8 registers = 0;
+
+    friend constexpr bool operator==(const Liveness &, const Liveness &) = default;
+};
+
+// What an instruction does whatever its operands' values. Writes are only ones that replace
+// the whole value, so a byte register write or a shift by cl doesn't count.
+struct Effect {
+    Liveness reads;
+    Liveness writes;
+    bool leaves = false; // may also run code the graph doesn't see, like an interrupt handler
+};
+
+[[nodiscard]] Effect effect(const instructions::Instruction &inst) noexcept;
+
+// Just the flags effect() would say are read, cheap enough to ask before every instruction
+[[nodiscard]] u16 flags_read(const instructions::Instruction &inst) noexcept;
+
+struct Block {
+    u16 start;
+    std::vector<instructions::Instruction> instructions;
+    std::vector<std::size_t> successors; // indices into Graph::get_blocks()
+    bool leaves = false;                 // can also end up somewhere the graph doesn't follow
+
+    Liveness live_in;
+    Liveness live_out;
+};
+
+class Graph {
+public:
+    // Decodes everything reachable from entry within the first image_size bytes of memory
+    [[nodiscard]] static Graph build(std::span<const u8> memory, std::size_t image_size,
+                                     u16 entry) noexcept;
+
+    [[nodiscard]] const std::vector<Block> &get_blocks() const noexcept { return blocks; }
+
+    // Flags the instruction at address writes that every path overwrites before reading.
+    // 0 for addresses the graph never reached.
+    [[nodiscard]] u16 dead_flags(u16 address) const noexcept {
+        return address < dead.size() ? dead[address] : 0;
+    }
+
+    // Graphviz source, one node per block with its instructions and what's live on entry
+    [[nodiscard]] std::string dot() const noexcept;
+
+private:
+    std::vector<Block> blocks;
+    std::vector<u16> dead;
+};
+
+} // namespace sim::cfg
@@ -0,0 +1,498 @@
+#include "common.hpp"
+
+#include "debugger.hpp"
+#include "decode.hpp"
+#include "image.hpp"
+#include "instructions.hpp"
+
+#include <algorithm>
+#include <cctype>
+#include <charconv>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <tuple>
+
+namespace sim::debug {
+
+namespace {
+    std::string_view trim(std::string_view s) noexcept {
+        const auto first = s.find_first_not_of(" \t\r");
+        if (first == std::string_view::npos)
+            return {};
+
+        const auto last = s.find_last_not_of(" \t\r");
+        return s.substr(first, last - first + 1);
+    }
+
+    // splits off the first whitespace-separated word
+    std::pair<std::string_view, std::string_view> split(std::string_view s) noexcept {
+        s = trim(s);
+        const auto space = s.find_first_of(" \t");
+        if (space == std::string_view::npos)
+            return {s, {}};
+
+        return {s.substr(0, space), trim(s.substr(space))};
+    }
+
+    // decimal, 0x-prefixed hex, or negative decimal as two's complement
+    std::optional<u16> parse_number(std::string_view s) noexcept {
+        bool negative = false;
+        if (!s.empty() && s[0] == '-') {
+            negative = true;
+            s.remove_prefix(1);
+        }
+
+        int base = 10;
+        if (s.size() > 2 && s[0] == '0' && (s[1] == 'x' || s[1] == 'X')) {
+            base = 16;
+            s.remove_prefix(2);
+        }
+
+        unsigned value = 0;
+        const auto [end, ec] = std::from_chars(s.data(), s.data() + s.size(), value, base);
+        if (ec != std::errc{} || end != s.data() + s.size() || value > 0xFFFF)
+            return std::nullopt;
+
+        return static_cast<u16>(negative ? -value : value);
+    }
+
+    std::string hex(u16 value, int digits = 4, bool prefix = true) {
+        std::stringstream ss;
+        ss << (prefix ? "0x" : "") << std::hex << std::setw(digits) << std::setfill('0') << value;
+        return ss.str();
+    }
+
+    struct Name {
+        Condition::Source source;
+        registers::RegAccess reg;
+        flags::Flag flag;
+    };
+
+    std::optional<Name> lookup(std::string_view name) noexcept {
+        if (name == "ip")
+            return Name{Condition::Source::IP, {}, {}};
+
+        for (u8 i = 0; i < registers::REG_NAMES.size(); i++) {
+            if (name == registers::REG_NAMES[i])
+                return Name{Condition::Source::REGISTER, {i, true}, {}};
+        }
+
+        for (u8 i = 0; i < registers::SEGMENT_NAMES.size(); i++) {
+            if (name == registers::SEGMENT_NAMES[i])
+                return Name{Condition::Source::SEGMENT, {i, true}, {}};
+        }
+
+        for (u8 i = 0; i < registers::REG_NAMES_LOW.size(); i++) {
+            if (name == registers::REG_NAMES_LOW[i])
+                return Name{Condition::Source::REGISTER, {i, false}, {}};
+            if (name == registers::REG_NAMES_HIGH[i])
+                return Name{Condition::Source::REGISTER, {static_cast<u8>(i | 0b100), false}, {}};
+        }
+
+        for (const auto &[flag, flag_name] : flags::FLAG_NAMES) {
+            const bool matches = std::equal(name.begin(), name.end(), flag_name.begin(),
+                                            flag_name.end(), [](char a, char b) {
+                                                return std::tolower(a) == std::tolower(b);
+                                            });
+            if (matches)
+                return Name{Condition::Source::FLAG, {}, flag};
+        }
+
+        return std::nullopt;
+    }
+
+    u16 read(const Name &name, const runner::Runner &runner) noexcept {
+        switch (name.source) {
+        case Condition::Source::REGISTER:
+            return runner.get_registers().read(name.reg);
+        case Condition::Source::SEGMENT:
+            return runner.get_registers().read_segment(name.reg.index);
+        case Condition::Source::FLAG:
+            return runner.get_flags().test_flag(name.flag);
+        case Condition::Source::IP:
+            return runner.get_ip();
+        }
+        return 0;
+    }
+
+    std::string disassemble_at(const runner::Runner &runner, u16 ip) {
+        const auto memory = runner.get_memory().first(image::GuestMemory::SEGMENT_SIZE);
+        const auto inst = decode::try_decode(memory, ip);
+        return inst ? instructions::Instruction::string(*inst) : "(does not decode)";
+    }
+} // namespace
+
+std::optional<Condition> Condition::parse(std::string_view text) noexcept {
+    const auto [lhs, rest] = split(text);
+    const auto [op_text, rhs] = split(rest);
+
+    const auto name = lookup(lhs);
+    const auto value = parse_number(rhs);
+    if (!name || !value)
+        return std::nullopt;
+
+    static constexpr std::array<std::pair<std::string_view, Op>, 6> OPS = {{
+        {"==", Op::EQ},
+        {"!=", Op::NE},
+        {"<", Op::LT},
+        {"<=", Op::LE},
+        {">", Op::GT},
+        {">=", Op::GE},
+    }};
+
+    for (const auto &[op_name, op] : OPS) {
+        if (op_text == op_name) {
+            return Condition{
+                .source = name->source,
+                .reg = name->reg,
+                .flag = name->flag,
+                .op = op,
+                .value = *value,
+                .text = std::string(trim(text)),
+            };
+        }
+    }
+
+    return std::nullopt;
+}
+
+bool Condition::holds(const runner::Runner &runner) const noexcept {
+    const u16 actual = read(Name{source, reg, flag}, runner);
+
+    switch (op) {
+    // clang-format off
+    case Op::EQ: return actual == value;
+    case Op::NE: return actual != value;
+    case Op::LT: return actual < value;
+    case Op::LE: return actual <= value;
+    case Op::GT: return actual > value;
+    case Op::GE: return actual >= value;
+    // clang-format on
+    }
+    return false;
+}
+
+bool AddressSet::any(u16 start, u16 end) const noexcept {
+    // whole words at a time, masking off the partial ones at either end
+    for (std::size_t word = start / 64; word <= static_cast<std::size_t>(end - 1) / 64; word++) {
+        std::uint64_t set = bits[word];
+        if (word == start / 64)
+            set &= ~std::uint64_t{0} << (start % 64);
+        if (word == static_cast<std::size_t>(end - 1) / 64 && end % 64 != 0)
+            set &= ~(~std::uint64_t{0} << (end % 64));
+
+        if (set)
+            return true;
+    }
+
+    return false;
+}
+
+const BlockCache::Block &BlockCache::at(const runner::Runner &runner, u16 ip) noexcept {
+    Block &block = blocks[ip];
+    if (block.decoded)
+        return block;
+
+    const auto memory = runner.get_memory().first(image::GuestMemory::SEGMENT_SIZE);
+    const std::size_t image_end = runner.get_image().size();
+
+    std::size_t address = ip;
+    u16 count = 0;
+
+    while (address < image_end && count < 256) {
+        const auto inst = decode::try_decode(memory, static_cast<u16>(address));
+        if (!inst || address + inst->bytes.size() > 0xFFFF)
+            break;
+
+        address += inst->bytes.size();
+        count++;
+
+        if (instructions::ends_block(inst->mnemonic))
+            break;
+    }
+
+    block.end = static_cast<u16>(address);
+    block.count = count;
+    block.decoded = true;
+    return block;
+}
+
+Debugger::Debugger(runner::Runner &runner, std::ostream &out) noexcept
+    : runner(runner), out(out) {}
+
+void Debugger::session(std::istream &in, bool interactive) noexcept {
+    std::string line;
+
+    for (;;) {
+        if (interactive)
+            out << "(8086) " << std::flush;
+
+        if (!std::getline(in, line))
+            break;
+
+        const auto command = trim(line);
+        if (command.empty() || command[0] == '#')
+            continue;
+
+        // echo scripted commands so the transcript reads like an interactive session
+        if (!interactive)
+            out << "(8086) " << command << '\n';
+
+        if (!execute(command))
+            break;
+    }
+}
+
+bool Debugger::execute(std::string_view line) noexcept {
+    const auto [command, args] = split(line);
+
+    if (command == "break" || command == "b") {
+        add_breakpoint(args);
+    } else if (command == "delete" || command == "d") {
+        delete_breakpoint(args);
+    } else if (command == "info" || command == "i") {
+        list_breakpoints();
+    } else if (command == "continue" || command == "c") {
+        resume();
+    } else if (command == "step" || command == "s") {
+        step(args);
+    } else if (command == "regs" || command == "r") {
+        print_registers();
+    } else if (command == "print" || command == "p") {
+        print_value(args);
+    } else if (command == "x") {
+        dump_memory(args);
+    } else if (command == "quit" || command == "q") {
+        return false;
+    } else {
+        out << "unknown command: " << command << '\n';
+    }
+
+    return true;
+}
+
+void Debugger::add_breakpoint(std::string_view args) noexcept {
+    Breakpoint breakpoint;
+
+    auto [first, rest] = split(args);
+    if (first != "if") {
+        breakpoint.address = parse_number(first);
+        if (!breakpoint.address) {
+            out << "usage: break <addr> [if <cond>] | break if <cond>\n";
+            return;
+        }
+
+        std::tie(first, rest) = split(rest);
+    }
+
+    if (first == "if") {
+        breakpoint.condition = Condition::parse(rest);
+        if (!breakpoint.condition) {
+            out << "bad condition: " << rest << '\n';
+            return;
+        }
+    } else if (!first.empty()) {
+        out << "usage: break <addr> [if <cond>] | break if <cond>\n";
+        return;
+    }
+
+    const int id = next_id++;
+    out << "breakpoint " << id;
+    if (breakpoint.address)
+        out << " at " << hex(*breakpoint.address);
+    if (breakpoint.condition)
+        out << " if " << breakpoint.condition->text;
+    out << '\n';
+
+    breakpoints.emplace(id, std::move(breakpoint));
+    rebuild_addresses();
+}
+
+void Debugger::delete_breakpoint(std::string_view args) noexcept {
+    const auto id = parse_number(args);
+    if (!id || !breakpoints.erase(*id)) {
+        out << "no breakpoint " << args << '\n';
+        return;
+    }
+
+    rebuild_addresses();
+}
+
+void Debugger::list_breakpoints() const noexcept {
+    if (breakpoints.empty())
+        out << "no breakpoints\n";
+
+    for (const auto &[id, breakpoint] : breakpoints) {
+        out << id << ":";
+        if (breakpoint.address)
+            out << " " << hex(*breakpoint.address);
+        if (breakpoint.condition)
+            out << " if " << breakpoint.condition->text;
+        out << '\n';
+    }
+}
+
+void Debugger::rebuild_addresses() noexcept {
+    addresses.clear();
+    global_conditions = 0;
+
+    for (const auto &[id, breakpoint] : breakpoints) {
+        if (breakpoint.address)
+            addresses.insert(*breakpoint.address);
+        else
+            global_conditions++;
+    }
+}
+
+std::optional<int> Debugger::hit(u16 ip) const noexcept {
+    if (!addresses.contains(ip) && global_conditions == 0)
+        return std::nullopt;
+
+    for (const auto &[id, breakpoint] : breakpoints) {
+        if (breakpoint.address && *breakpoint.address != ip)
+            continue;
+        if (!breakpoint.address && !breakpoint.condition)
+            continue;
+        if (breakpoint.condition && !breakpoint.condition->holds(runner))
+            continue;
+
+        return id;
+    }
+
+    return std::nullopt;
+}
+
+void Debugger::resume() noexcept {
+    // step off a breakpoint we might be sitting on, or continue would stop right where it is
+    if (!step_one())
+        return;
+
+    for (;;) {
+        if (runner.halted()) {
+            report_stop("program halted");
+            return;
+        }
+
+        const u16 start = runner.get_ip();
+        const auto &block = blocks.at(runner, start);
+
+        // slow path: only blocks with something to check in them go an instruction at a time
+        if (block.count == 0 || global_conditions != 0 || addresses.any(start, block.end)) {
+            if (const auto id = hit(start)) {
+                report_stop("breakpoint " + std::to_string(*id));
+                return;
+            }
+
+            if (!step_one())
+                return;
+            continue;
+        }
+
+        for (u16 i = 0; i < block.count; i++) {
+            if (!step_one())
+                return;
+
+            // a faulting DIV can leave the block early
+            const u16 ip = runner.get_ip();
+            if (ip < start || ip >= block.end)
+                break;
+        }
+    }
+}
+
+void Debugger::step(std::string_view args) noexcept {
+    const auto count = args.empty() ? std::optional<u16>(1) : parse_number(args);
+    if (!count) {
+        out << "usage: step [n]\n";
+        return;
+    }
+
+    for (u16 i = 0; i < *count; i++) {
+        const u16 ip = runner.get_ip();
+        const auto line = disassemble_at(runner, ip);
+
+        if (!step_one())
+            return;
+
+        out << line << '\n';
+    }
+}
+
+bool Debugger::step_one() noexcept {
+    if (runner.halted()) {
+        report_stop("program halted");
+        return false;
+    }
+
+    if (!runner.step()) {
+        report_stop(runner.left_code_segment() ? "cs can only be 0" : "failed to decode");
+        return false;
+    }
+
+    return true;
+}
+
+void Debugger::report_stop(std::string_view why) const noexcept {
+    const u16 ip = runner.get_ip();
+    out << why << " at " << hex(ip) << '\n';
+
+    if (!runner.halted())
+        out << disassemble_at(runner, ip) << '\n';
+}
+
+void Debugger::print_registers() const noexcept {
+    const auto &regfile = runner.get_registers();
+
+    for (u8 i = 0; i < registers::REG_NAMES.size(); i++) {
+        out << registers::REG_NAMES[i] << ": " << hex(regfile.read({i, true}))
+            << (i % 4 == 3 ? "\n" : "  ");
+    }
+
+    for (u8 i = 0; i < registers::SEGMENT_NAMES.size(); i++) {
+        out << registers::SEGMENT_NAMES[i] << ": " << hex(regfile.read_segment(i))
+            << (i == 3 ? "\n" : "  ");
+    }
+
+    out << "ip: " << hex(runner.get_ip()) << "  flags:";
+    for (const auto &[flag, name] : flags::FLAG_NAMES) {
+        if (runner.get_flags().test_flag(flag))
+            out << ' ' << name;
+    }
+    out << '\n';
+}
+
+void Debugger::print_value(std::string_view args) const noexcept {
+    const auto name = lookup(args);
+    if (!name) {
+        out << "unknown register or flag: " << args << '\n';
+        return;
+    }
+
+    const u16 value = read(*name, runner);
+    out << args << " = " << hex(value) << " (" << value << ")\n";
+}
+
+void Debugger::dump_memory(std::string_view args) const noexcept {
+    const auto [address_text, count_text] = split(args);
+    const auto address = parse_number(address_text);
+    const auto count = count_text.empty() ? std::optional<u16>(16) : parse_number(count_text);
+
+    if (!address || !count) {
+        out << "usage: x <addr> [n]\n";
+        return;
+    }
+
+    const auto memory = runner.get_memory();
+    for (std::size_t i = 0; i < *count; i++) {
+        const u16 at = static_cast<u16>(*address + i);
+        if (i % 16 == 0)
+            out << (i ? "\n" : "") << hex(at) << ":";
+
+        out << ' ' << hex(memory[at], 2, false);
+    }
+    out << '\n';
+}
+
+} // namespace sim::debug
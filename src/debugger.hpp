@@ -0,0 +1,132 @@
+#pragma once
+
+#include "common.hpp"
+
+#include "flags.hpp"
+#include "registers.hpp"
+#include "runner.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <iosfwd>
+#include <map>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace sim::debug {
+
+// "<register|flag|ip> <op> <value>", e.g. "cx == 0", "zf != 1", "al > 0x7f"
+struct Condition {
+    enum class Source : u8 { REGISTER, SEGMENT, FLAG, IP };
+    enum class Op : u8 { EQ, NE, LT, LE, GT, GE };
+
+    Source source;
+    registers::RegAccess reg;
+    flags::Flag flag;
+    Op op;
+    u16 value;
+    std::string text;
+
+    [[nodiscard]] static std::optional<Condition> parse(std::string_view text) noexcept;
+    [[nodiscard]] bool holds(const runner::Runner &runner) const noexcept;
+};
+
+// One bit per ip, so a run loop can ask "is anything set in this block" once per block instead of
+// testing every instruction
+class AddressSet {
+public:
+    void clear() noexcept { bits.fill(0); }
+    void insert(u16 ip) noexcept { bits[ip / 64] |= bit(ip); }
+    void erase(u16 ip) noexcept { bits[ip / 64] &= ~bit(ip); }
+    [[nodiscard]] bool contains(u16 ip) const noexcept { return bits[ip / 64] & bit(ip); }
+
+    // anything in [start, end)
+    [[nodiscard]] bool any(u16 start, u16 end) const noexcept;
+
+private:
+    static constexpr std::uint64_t bit(u16 ip) noexcept { return std::uint64_t{1} << (ip % 64); }
+
+    std::array<std::uint64_t, (1 << 16) / 64> bits = {};
+};
+
+// Straight-line runs of instructions, each from some ip up to and including the first one that
+// ends a block
+class BlockCache {
+public:
+    struct Block {
+        u16 end = 0;
+        u16 count = 0;        // 0 when ip doesn't decode or is past the image
+        bool decoded = false; // set once looked at, so an empty block is cached too
+    };
+
+    BlockCache() : blocks(1 << 16) {}
+
+    [[nodiscard]] const Block &at(const runner::Runner &runner, u16 ip) noexcept;
+    void clear() noexcept { std::fill(blocks.begin(), blocks.end(), Block{}); }
+
+private:
+    // NOTE(louis): blocks are cached by start address and never invalidated. A stale one is still
+    // safe: breakpoints are checked over all of [start, end) and the fast path leaves the block as
+    // soon as ip does, so rewritten code only costs extra trips through the slow path. That
+    // includes an empty block at an ip that decodes later on.
+    std::vector<Block> blocks;
+};
+
+struct Breakpoint {
+    std::optional<u16> address; // unset for a condition checked everywhere
+    std::optional<Condition> condition;
+};
+
+// Line-oriented debugger over a Runner, read from a terminal or a script.
+//
+//   break <addr> [if <cond>]   b     stop at addr, optionally only when cond holds
+//   break if <cond>                  stop wherever cond holds (checked every instruction)
+//   delete <n>                 d     remove breakpoint n
+//   info                       i     list breakpoints
+//   continue                   c     run until a breakpoint or the end of the program
+//   step [n]                   s     execute n instructions (default 1), printing each
+//   regs                       r     registers, ip and flags
+//   print <reg|flag|ip>        p
+//   x <addr> [n]                     dump n bytes of memory (default 16)
+//   quit                       q
+class Debugger {
+public:
+    Debugger(runner::Runner &runner, std::ostream &out) noexcept;
+
+    // Runs commands until quit or end of input. A prompt is printed when interactive.
+    void session(std::istream &in, bool interactive) noexcept;
+
+    // Returns false once the session should end
+    bool execute(std::string_view line) noexcept;
+
+private:
+    runner::Runner &runner;
+    std::ostream &out;
+
+    std::map<int, Breakpoint> breakpoints;
+    int next_id = 1;
+    std::size_t global_conditions = 0;
+
+    AddressSet addresses;
+    BlockCache blocks;
+
+    [[nodiscard]] std::optional<int> hit(u16 ip) const noexcept;
+    void rebuild_addresses() noexcept;
+
+    void add_breakpoint(std::string_view args) noexcept;
+    void delete_breakpoint(std::string_view args) noexcept;
+    void list_breakpoints() const noexcept;
+    void resume() noexcept;
+    void step(std::string_view args) noexcept;
+    void print_registers() const noexcept;
+    void print_value(std::string_view args) const noexcept;
+    void dump_memory(std::string_view args) const noexcept;
+
+    [[nodiscard]] bool step_one() noexcept;
+    void report_stop(std::string_view why) const noexcept;
+};
+
+} // namespace sim::debug
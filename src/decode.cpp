@@ -38,7 +38,8 @@ namespace {
 
         case 0b01: {
             auto [reg1, reg2] = EFFECTIVE_ADDRESSES[rm];
-            return Operand::effective_address(reg1, reg2, reader.byte(), is_wide);
+            const u16 disp = static_cast<u16>(static_cast<s8>(reader.byte()));
+            return Operand::effective_address(reg1, reg2, disp, is_wide);
         }
 
         case 0b10: {
@@ -71,6 +72,23 @@ namespace {
         };
     }
 
+    [[nodiscard]] const instructions::Instruction segment_with_rm(sim::mem::MemoryReader &reader,
+                                                                  const table::Encoding &encoding,
+                                                                  u8 first) noexcept {
+        auto fields = InstructionFields::from(encoding, first, reader.byte());
+
+        instructions::Operand sr = instructions::Operand::segment(fields.reg);
+        instructions::Operand rm = decode_rm(reader, true, fields.mod, fields.rm);
+
+        return instructions::Instruction{
+            .mnemonic = encoding.mnemonic,
+            .dst = fields.is_reg_dst ? sr : rm,
+            .src = fields.is_reg_dst ? rm : sr,
+            .address = reader.get_start_address(),
+            .bytes = reader.get_bytes_read(),
+        };
+    }
+
     [[nodiscard]] const instructions::Instruction
     imm_to_rm(sim::mem::MemoryReader &reader, const table::Encoding &encoding, u8 first) noexcept {
         auto fields = InstructionFields::from(encoding, first, reader.byte());
@@ -131,9 +149,113 @@ namespace {
         };
     }
 
+    [[nodiscard]] const instructions::Instruction reg(sim::mem::MemoryReader &reader,
+                                                      const table::Encoding &encoding,
+                                                      u8 first) noexcept {
+        auto fields = InstructionFields::from(encoding, first);
+
+        return instructions::Instruction{
+            .mnemonic = encoding.mnemonic,
+            .dst = instructions::Operand::reg(fields.reg, true),
+            .src = instructions::Operand::none(),
+            .address = reader.get_start_address(),
+            .bytes = reader.get_bytes_read(),
+        };
+    }
+
+    [[nodiscard]] const instructions::Instruction segment(sim::mem::MemoryReader &reader,
+                                                          const table::Encoding &encoding,
+                                                          u8 first) noexcept {
+        auto fields = InstructionFields::from(encoding, first);
+
+        return instructions::Instruction{
+            .mnemonic = encoding.mnemonic,
+            .dst = instructions::Operand::segment(fields.reg),
+            .src = instructions::Operand::none(),
+            .address = reader.get_start_address(),
+            .bytes = reader.get_bytes_read(),
+        };
+    }
+
+    [[nodiscard]] const instructions::Instruction
+    rm(sim::mem::MemoryReader &reader, const table::Encoding &encoding, u8 first) noexcept {
+        auto fields = InstructionFields::from(encoding, first, reader.byte());
+
+        return instructions::Instruction{
+            .mnemonic = encoding.mnemonic,
+            .dst = decode_rm(reader, fields.is_wide, fields.mod, fields.rm),
+            .src = instructions::Operand::none(),
+            .address = reader.get_start_address(),
+            .bytes = reader.get_bytes_read(),
+        };
+    }
+
+    [[nodiscard]] const instructions::Instruction reg_with_acc(sim::mem::MemoryReader &reader,
+                                                               const table::Encoding &encoding,
+                                                               u8 first) noexcept {
+        auto fields = InstructionFields::from(encoding, first);
+
+        return instructions::Instruction{
+            .mnemonic = encoding.mnemonic,
+            .dst = instructions::Operand::reg(registers::AX, true),
+            .src = instructions::Operand::reg(fields.reg, true),
+            .address = reader.get_start_address(),
+            .bytes = reader.get_bytes_read(),
+        };
+    }
+
+    [[nodiscard]] const instructions::Instruction
+    shift(sim::mem::MemoryReader &reader, const table::Encoding &encoding, u8 first) noexcept {
+        auto fields = InstructionFields::from(encoding, first, reader.byte());
+
+        const bool count_in_cl = fields.is_reg_dst;
+        instructions::Operand count = count_in_cl
+                                          ? instructions::Operand::reg(registers::CX, false)
+                                          : instructions::Operand::imm(1);
+
+        return instructions::Instruction{
+            .mnemonic = encoding.mnemonic,
+            .dst = decode_rm(reader, fields.is_wide, fields.mod, fields.rm),
+            .src = count,
+            .address = reader.get_start_address(),
+            .bytes = reader.get_bytes_read(),
+        };
+    }
+
     [[nodiscard]] const instructions::Instruction jump(sim::mem::MemoryReader &reader,
                                                        const table::Encoding &encoding) noexcept {
-        instructions::Operand imm = instructions::Operand::imm(reader.byte());
+        u16 disp = reader.byte();
+        if (disp & 0x80) {
+            disp |= 0xFF00;
+        }
+
+        return instructions::Instruction{
+            .mnemonic = encoding.mnemonic,
+            .dst = instructions::Operand::rel(disp),
+            .src = instructions::Operand::none(),
+            .address = reader.get_start_address(),
+            .bytes = reader.get_bytes_read(),
+        };
+    }
+
+    [[nodiscard]] const instructions::Instruction
+    jump_near(sim::mem::MemoryReader &reader, const table::Encoding &encoding) noexcept {
+        instructions::Operand disp = instructions::Operand::rel(reader.word());
+
+        return instructions::Instruction{
+            .mnemonic = encoding.mnemonic,
+            .dst = disp,
+            .src = instructions::Operand::none(),
+            .address = reader.get_start_address(),
+            .bytes = reader.get_bytes_read(),
+        };
+    }
+
+    [[nodiscard]] const instructions::Instruction imm(sim::mem::MemoryReader &reader,
+                                                      const table::Encoding &encoding,
+                                                      bool is_wide) noexcept {
+        instructions::Operand imm =
+            instructions::Operand::imm(is_wide ? reader.word() : reader.byte());
 
         return instructions::Instruction{
             .mnemonic = encoding.mnemonic,
@@ -143,15 +265,57 @@ namespace {
             .bytes = reader.get_bytes_read(),
         };
     }
+
+    // NOTE(louis): the accumulator is the destination of IN and the source of OUT
+    [[nodiscard]] const instructions::Instruction port(sim::mem::MemoryReader &reader,
+                                                       const table::Encoding &encoding, u8 first,
+                                                       bool in_dx) noexcept {
+        auto fields = InstructionFields::from(encoding, first);
+
+        instructions::Operand acc = instructions::Operand::reg(registers::AX, fields.is_wide);
+        instructions::Operand port = in_dx ? instructions::Operand::reg(registers::DX, true)
+                                           : instructions::Operand::imm(reader.byte());
+
+        const bool is_in = encoding.mnemonic == instructions::Mnemonic::IN;
+        return instructions::Instruction{
+            .mnemonic = encoding.mnemonic,
+            .dst = is_in ? acc : port,
+            .src = is_in ? port : acc,
+            .address = reader.get_start_address(),
+            .bytes = reader.get_bytes_read(),
+        };
+    }
+
+    [[nodiscard]] const instructions::Instruction
+    no_operands(sim::mem::MemoryReader &reader, const table::Encoding &encoding) noexcept {
+        return instructions::Instruction{
+            .mnemonic = encoding.mnemonic,
+            .dst = instructions::Operand::none(),
+            .src = instructions::Operand::none(),
+            .address = reader.get_start_address(),
+            .bytes = reader.get_bytes_read(),
+        };
+    }
 } // namespace
 
-const std::optional<instructions::Instruction> try_decode(const std::vector<u8> &memory,
-                                                          u8 address) noexcept {
+const std::optional<instructions::Instruction> try_decode(std::span<const u8> memory,
+                                                          u16 address) noexcept {
     mem::MemoryReader reader(memory, address);
     u8 byte = reader.byte();
 
-    for (const auto &encoding : table::instruction_encodings) {
-        if (!table::Encoding::matches(encoding, byte, reader.peek_byte()))
+    instructions::Prefix prefix = instructions::Prefix::NONE;
+    std::optional<u8> segment_override;
+    for (;; byte = reader.byte()) {
+        if (byte == 0xF2 || byte == 0xF3)
+            prefix = (byte == 0xF3) ? instructions::Prefix::REP : instructions::Prefix::REPNE;
+        else if ((byte & 0xE7) == 0x26) // 001sr110
+            segment_override = (byte >> 3) & 0b11;
+        else
+            break;
+    }
+
+    for (const auto &encoding : table::candidates(byte)) {
+        if (!encoding.second.matches(reader.peek_byte()))
             continue;
 
         instructions::Instruction instruction;
@@ -159,6 +323,9 @@ const std::optional<instructions::Instruction> try_decode(const std::vector<u8>
         case table::Encoding::Type::RM_WITH_REG:
             instruction = rm_with_reg(reader, encoding, byte);
             break;
+        case table::Encoding::Type::SEGMENT_WITH_RM:
+            instruction = segment_with_rm(reader, encoding, byte);
+            break;
         case table::Encoding::Type::IMM_WITH_RM:
             instruction = imm_to_rm(reader, encoding, byte);
             break;
@@ -168,9 +335,58 @@ const std::optional<instructions::Instruction> try_decode(const std::vector<u8>
         case table::Encoding::Type::IMM_WITH_ACC:
             instruction = imm_to_acc(reader, encoding, byte);
             break;
+        case table::Encoding::Type::REG:
+            instruction = reg(reader, encoding, byte);
+            break;
+        case table::Encoding::Type::REG_WITH_ACC:
+            instruction = reg_with_acc(reader, encoding, byte);
+            break;
+        case table::Encoding::Type::SEGMENT:
+            instruction = segment(reader, encoding, byte);
+            break;
+        case table::Encoding::Type::RM:
+            instruction = rm(reader, encoding, byte);
+            break;
+        case table::Encoding::Type::SHIFT:
+            instruction = shift(reader, encoding, byte);
+            break;
         case table::Encoding::Type::JUMP:
             instruction = jump(reader, encoding);
             break;
+        case table::Encoding::Type::JUMP_NEAR:
+            instruction = jump_near(reader, encoding);
+            break;
+        case table::Encoding::Type::IMM_BYTE:
+            instruction = imm(reader, encoding, false);
+            break;
+        case table::Encoding::Type::IMM_WORD:
+            instruction = imm(reader, encoding, true);
+            break;
+        case table::Encoding::Type::PORT_FIXED:
+            instruction = port(reader, encoding, byte, false);
+            break;
+        case table::Encoding::Type::PORT_VARIABLE:
+            instruction = port(reader, encoding, byte, true);
+            break;
+        case table::Encoding::Type::NO_OPERANDS:
+            instruction = no_operands(reader, encoding);
+            break;
+        }
+
+        if (reader.has_overrun())
+            return std::nullopt;
+
+        // NOTE(louis): the prefix bytes were read first, so they're already in instruction.bytes
+        instruction.prefix = prefix;
+        instruction.segment = segment_override;
+
+        if (segment_override) {
+            for (auto *operand : {&instruction.dst, &instruction.src}) {
+                if (operand->type != instructions::Operand::Type::MEMORY)
+                    continue;
+                operand->mem_access.segment = *segment_override;
+                operand->mem_access.is_override = true;
+            }
         }
 
         return instruction;
@@ -6,7 +6,7 @@
 #include "table.hpp"
 
 #include <optional>
-#include <vector>
+#include <span>
 
 namespace sim::decode {
 namespace {
@@ -45,6 +45,6 @@ namespace {
 } // namespace
 
 [[nodiscard]] const std::optional<instructions::Instruction>
-try_decode(const std::vector<u8> &memory, u8 address) noexcept;
+try_decode(std::span<const u8> memory, u16 address) noexcept;
 
 } // namespace sim::decode
@@ -0,0 +1,265 @@
+#include "common.hpp"
+
+#include "devices.hpp"
+
+#include <bit>
+
+namespace sim::devices {
+
+namespace {
+    // 4.77 MHz / 60 Hz, with the last 4000 or so clocks of each frame in vertical retrace
+    constexpr std::uint64_t FRAME_CYCLES = 79545;
+    constexpr std::uint64_t RETRACE_CYCLES = 4000;
+    constexpr std::uint64_t LINE_CYCLES = 304;
+} // namespace
+
+u16 Pic::in(u16 port, bool, io::Time) noexcept {
+    if (port & 1)
+        return imr;
+    return read_isr ? isr : irr;
+}
+
+void Pic::out(u16 port, u16 value, bool, io::Time) noexcept {
+    const u8 byte = value & 0xFF;
+
+    if (!(port & 1)) {
+        if (byte & 0x10) {
+            // ICW1 starts initialisation over
+            init = Init::ICW2;
+            single = byte & 0x02;
+            needs_icw4 = byte & 0x01;
+            auto_eoi = false;
+            imr = 0;
+            isr = 0;
+            read_isr = false;
+        } else if (byte & 0x08) {
+            // OCW3, only the register read select matters here
+            if (byte & 0x02)
+                read_isr = byte & 0x01;
+        } else if ((byte & 0xE0) == 0x20 && isr) {
+            // non-specific EOI ends the highest priority interrupt in service
+            isr &= static_cast<u8>(isr - 1);
+        } else if ((byte & 0xE0) == 0x60) {
+            isr &= static_cast<u8>(~(1 << (byte & 0x07)));
+        }
+        return;
+    }
+
+    switch (init) {
+    case Init::ICW2:
+        base = byte & 0xF8;
+        init = !single ? Init::ICW3 : needs_icw4 ? Init::ICW4 : Init::DONE;
+        break;
+    case Init::ICW3:
+        init = needs_icw4 ? Init::ICW4 : Init::DONE;
+        break;
+    case Init::ICW4:
+        auto_eoi = byte & 0x02;
+        init = Init::DONE;
+        break;
+    case Init::DONE:
+        imr = byte;
+        break;
+    }
+}
+
+std::optional<u8> Pic::interrupt(io::Time) noexcept {
+    const u8 pending = irr & ~imr;
+    if (!pending)
+        return std::nullopt;
+
+    // lower IRQ numbers win, and nothing gets past one of equal or higher priority in service
+    const int irq = std::countr_zero(pending);
+    if (isr && std::countr_zero(isr) <= irq)
+        return std::nullopt;
+
+    const u8 bit = static_cast<u8>(1 << irq);
+    irr &= ~bit;
+    if (!auto_eoi)
+        isr |= bit;
+
+    return static_cast<u8>(base + irq);
+}
+
+u16 Pit::Channel::count(std::uint64_t tick) const noexcept {
+    if (!counting)
+        return reload;
+
+    const std::uint64_t elapsed = tick - start;
+    if (mode == 0)
+        return static_cast<u16>(period() - elapsed);
+    return static_cast<u16>(period() - elapsed % period());
+}
+
+u16 Pit::in(u16 port, bool, io::Time now) noexcept {
+    if ((port & 3) == 3)
+        return 0xFF;
+
+    Channel &channel = channels[port & 3];
+    const u16 value = channel.latch ? *channel.latch : channel.count(now.cycles / CYCLES_PER_TICK);
+
+    bool high = channel.access == 2;
+    bool done = true;
+    if (channel.access == 3) {
+        high = channel.reading_high;
+        done = high;
+        channel.reading_high = !channel.reading_high;
+    }
+
+    if (done)
+        channel.latch.reset();
+    return high ? value >> 8 : value & 0xFF;
+}
+
+void Pit::out(u16 port, u16 value, bool, io::Time now) noexcept {
+    const u8 byte = value & 0xFF;
+    const std::uint64_t tick = now.cycles / CYCLES_PER_TICK;
+
+    if ((port & 3) == 3) {
+        const u8 select = byte >> 6;
+        if (select == 3)
+            return; // 8254 read-back
+
+        Channel &channel = channels[select];
+        const u8 access = (byte >> 4) & 3;
+        if (access == 0) {
+            channel.latch = channel.count(tick);
+            return;
+        }
+
+        channel.access = access;
+        channel.mode = (byte >> 1) & 7;
+        if (channel.mode > 5)
+            channel.mode -= 4;
+        channel.counting = false;
+        channel.next_irq.reset();
+        channel.writing_high = false;
+        channel.reading_high = false;
+        channel.latch.reset();
+        return;
+    }
+
+    Channel &channel = channels[port & 3];
+    switch (channel.access) {
+    case 1:
+        channel.reload = byte;
+        break;
+    case 2:
+        channel.reload = static_cast<u16>(byte << 8);
+        break;
+    default:
+        if (!channel.writing_high) {
+            channel.low = byte;
+            channel.writing_high = true;
+            return;
+        }
+        channel.reload = static_cast<u16>(channel.low | (byte << 8));
+        channel.writing_high = false;
+        break;
+    }
+
+    channel.counting = true;
+    channel.start = tick;
+    if ((port & 3) == 0)
+        channel.next_irq = tick + channel.period();
+}
+
+std::uint64_t Pit::advance(io::Time now) noexcept {
+    Channel &channel = channels[0];
+    if (!channel.next_irq)
+        return bus::Bus::NEVER;
+
+    const std::uint64_t tick = now.cycles / CYCLES_PER_TICK;
+    if (*channel.next_irq <= tick) {
+        // however many periods went by, the PIC only latches the one edge
+        pic.raise(0);
+
+        if (channel.mode == 2 || channel.mode == 3) {
+            const std::uint64_t missed = (tick - *channel.next_irq) / channel.period();
+            *channel.next_irq += (missed + 1) * channel.period();
+        } else {
+            channel.next_irq.reset();
+            return bus::Bus::NEVER;
+        }
+    }
+
+    return *channel.next_irq * CYCLES_PER_TICK;
+}
+
+u8 TextDisplay::read(std::uint32_t address) noexcept {
+    return buffer[(address - base) % buffer.size()];
+}
+
+void TextDisplay::write(std::uint32_t address, u8 value) noexcept {
+    buffer[(address - base) % buffer.size()] = value;
+}
+
+u16 TextDisplay::in(u16 port, bool, io::Time now) noexcept {
+    switch (port - port_base) {
+    case 0x5:
+        return crtc_index < crtc.size() ? crtc[crtc_index] : 0xFF;
+    case 0xA: {
+        // NOTE(louis): retrace follows the cycle counter, so polling loops terminate and replay
+        // sees the same sequence
+        const bool vertical = now.cycles % FRAME_CYCLES >= FRAME_CYCLES - RETRACE_CYCLES;
+        const bool horizontal = now.cycles % LINE_CYCLES >= LINE_CYCLES * 3 / 4;
+        return (vertical ? 0x08 : 0) | (vertical || horizontal ? 0x01 : 0);
+    }
+    default:
+        return 0xFF;
+    }
+}
+
+void TextDisplay::out(u16 port, u16 value, bool is_wide, io::Time) noexcept {
+    switch (port - port_base) {
+    case 0x4:
+        crtc_index = value & 0xFF;
+        // a word write to the index port sets the register too
+        if (is_wide && crtc_index < crtc.size())
+            crtc[crtc_index] = value >> 8;
+        break;
+    case 0x5:
+        if (crtc_index < crtc.size())
+            crtc[crtc_index] = value & 0xFF;
+        break;
+    case 0x8:
+        mode = value & 0xFF;
+        break;
+    default:
+        break;
+    }
+}
+
+std::string TextDisplay::render() const noexcept {
+    // the start address is in words, from CRTC registers 12 and 13
+    const std::size_t start = ((crtc[12] << 8) | crtc[13]) * 2;
+
+    std::string out;
+    for (int row = 0; row < ROWS; row++) {
+        std::string line;
+        for (int column = 0; column < COLUMNS; column++) {
+            const u8 c = buffer[(start + (row * COLUMNS + column) * 2) % buffer.size()];
+            line += c == 0 ? ' ' : c >= 0x20 && c < 0x7F ? static_cast<char>(c) : '.';
+        }
+
+        line.erase(line.find_last_not_of(' ') + 1);
+        out += line;
+        out += '\n';
+    }
+    return out;
+}
+
+Pc::Pc() noexcept {
+    bus.map_ports(0x20, 0x21, pic);
+    bus.map_ports(0x40, 0x43, pit);
+    bus.map_ports(cga.get_port_base(), cga.get_port_base() + 0xF, cga);
+    bus.attach_clock(pit);
+    bus.attach_interrupt_controller(pic);
+}
+
+void Pc::attach(runner::Runner &runner) noexcept {
+    runner.map_memory(cga.get_base(), cga.get_size(), cga);
+    runner.attach_device(bus);
+}
+
+} // namespace sim::devices
@@ -0,0 +1,133 @@
+#pragma once
+
+#include "common.hpp"
+
+#include "bus.hpp"
+#include "io.hpp"
+#include "runner.hpp"
+
+#include <array>
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <vector>
+
+// The PC's basic peripherals, as much of each as real-mode programs tend to poke at.
+
+namespace sim::devices {
+
+// 8259A interrupt controller, a single one (no cascade). Starts out the way the BIOS leaves it:
+// IRQs at vectors 8-15, nothing masked.
+class Pic final : public io::Device {
+public:
+    void raise(u8 irq) noexcept { irr |= static_cast<u8>(1 << irq); }
+
+    [[nodiscard]] u16 in(u16 port, bool is_wide, io::Time now) noexcept override;
+    void out(u16 port, u16 value, bool is_wide, io::Time now) noexcept override;
+    [[nodiscard]] std::optional<u8> interrupt(io::Time now) noexcept override;
+
+private:
+    enum class Init : u8 { DONE, ICW2, ICW3, ICW4 };
+
+    u8 irr = 0; // requested
+    u8 isr = 0; // in service
+    u8 imr = 0; // masked
+    u8 base = 0x08;
+
+    Init init = Init::DONE;
+    bool single = true;
+    bool needs_icw4 = false;
+    bool auto_eoi = false;
+    bool read_isr = false;
+};
+
+// 8253 timer at 0x40-0x43, channel 0 wired to IRQ 0. Counts are derived from the cycle counter
+// (one PIT clock every 4 CPU clocks at 4.77 MHz) whenever they're looked at, rather than ticked.
+// NOTE(louis): mode 3 reads back like mode 2 (the real one counts down by 2 twice per period),
+// the interrupt rate is the same. BCD counting isn't supported.
+class Pit final : public io::Device, public bus::Clocked {
+public:
+    static constexpr std::uint64_t CYCLES_PER_TICK = 4;
+
+    explicit Pit(Pic &pic) noexcept : pic(pic) {}
+
+    [[nodiscard]] u16 in(u16 port, bool is_wide, io::Time now) noexcept override;
+    void out(u16 port, u16 value, bool is_wide, io::Time now) noexcept override;
+    [[nodiscard]] std::uint64_t advance(io::Time now) noexcept override;
+
+private:
+    struct Channel {
+        u8 mode = 0;
+        u8 access = 3; // 1 low byte, 2 high byte, 3 low then high
+        u16 reload = 0;
+        u8 low = 0;
+        bool writing_high = false;
+        bool reading_high = false;
+        std::optional<u16> latch;
+
+        bool counting = false;
+        std::uint64_t start = 0; // tick the count was loaded on
+        std::optional<std::uint64_t> next_irq;
+
+        [[nodiscard]] std::uint64_t period() const noexcept { return reload ? reload : 0x10000; }
+        [[nodiscard]] u16 count(std::uint64_t tick) const noexcept;
+    };
+
+    Pic &pic;
+    std::array<Channel, 3> channels;
+};
+
+// 80x25 text mode: the character buffer mapped into memory plus the 6845 CRTC's index/data
+// ports, mode control and status. CGA sits at B800:0000 with ports at 0x3D0, MDA at B000:0000
+// with ports at 0x3B0.
+class TextDisplay final : public io::Device, public bus::MemoryDevice {
+public:
+    static constexpr int COLUMNS = 80;
+    static constexpr int ROWS = 25;
+
+    [[nodiscard]] static TextDisplay cga() noexcept { return {0xB8000, 0x4000, 0x3D0}; }
+    [[nodiscard]] static TextDisplay mda() noexcept { return {0xB0000, 0x1000, 0x3B0}; }
+
+    [[nodiscard]] std::uint32_t get_base() const noexcept { return base; }
+    [[nodiscard]] std::uint32_t get_size() const noexcept { return buffer.size(); }
+    [[nodiscard]] u16 get_port_base() const noexcept { return port_base; }
+
+    [[nodiscard]] u8 read(std::uint32_t address) noexcept override;
+    void write(std::uint32_t address, u8 value) noexcept override;
+
+    [[nodiscard]] u16 in(u16 port, bool is_wide, io::Time now) noexcept override;
+    void out(u16 port, u16 value, bool is_wide, io::Time now) noexcept override;
+
+    // The visible page as plain text, one line per row with trailing blanks trimmed. Attributes
+    // are dropped and anything outside printable ASCII shows as '.'.
+    [[nodiscard]] std::string render() const noexcept;
+
+private:
+    TextDisplay(std::uint32_t base, std::uint32_t size, u16 port_base)
+        : base(base), port_base(port_base), buffer(size) {}
+
+    std::uint32_t base;
+    u16 port_base;
+    std::vector<u8> buffer;
+
+    std::array<u8, 18> crtc = {};
+    u8 crtc_index = 0;
+    u8 mode = 0;
+};
+
+// PIC at 0x20, PIT at 0x40 on IRQ 0 and CGA text at B800:0000, all behind one bus
+struct Pc {
+    Pic pic;
+    Pit pit{pic};
+    TextDisplay cga = TextDisplay::cga();
+    bus::Bus bus;
+
+    Pc() noexcept;
+    Pc(const Pc &) = delete;
+    Pc &operator=(const Pc &) = delete;
+
+    // Maps the display memory and makes the bus the runner's I/O device
+    void attach(runner::Runner &runner) noexcept;
+};
+
+} // namespace sim::devices
@@ -5,8 +5,6 @@
 
 namespace sim::flags {
 
-constexpr bool FlagState::test_flag(Flag f) const noexcept { return flags & f; }
-
 void FlagState::set_flag(Flag f, bool value) noexcept {
     if (value)
         flags |= f;
@@ -17,14 +15,12 @@ void FlagState::set_flag(Flag f, bool value) noexcept {
 std::string FlagState::format_changes(FlagState before) const noexcept {
     std::vector<std::string> changes;
 
-    for (std::size_t i = 0, flag = ZF; flag <= SF; i++, flag <<= 1) {
-        Flag enum_flag = static_cast<Flag>(flag);
-
-        bool was = before.test_flag(enum_flag);
-        bool is = this->test_flag(enum_flag);
+    for (const auto &[flag, name] : FLAG_NAMES) {
+        bool was = before.test_flag(flag);
+        bool is = this->test_flag(flag);
 
         if (was != is) {
-            changes.push_back(std::string(FLAG_NAMES[i]) + " -> " + (is ? "1" : "0"));
+            changes.push_back(std::string(name) + " -> " + (is ? "1" : "0"));
         }
     }
 
@@ -5,25 +5,49 @@
 #include <array>
 #include <string>
 #include <string_view>
+#include <utility>
 
 namespace sim::flags {
-namespace {
-    static constexpr std::array<std::string_view, 2> FLAG_NAMES = {"ZF", "SF"};
-}
 
-enum Flag {
-    ZF = 1 << 0,
-    SF = 1 << 1,
+// NOTE(louis): bit positions match the real FLAGS register so it can be pushed/popped as-is
+enum Flag : u16 {
+    CF = 1 << 0,
+    PF = 1 << 2,
+    AF = 1 << 4,
+    ZF = 1 << 6,
+    SF = 1 << 7,
+    TF = 1 << 8,
+    IF = 1 << 9,
+    DF = 1 << 10,
+    OF = 1 << 11,
 };
 
+namespace {
+    // display order for format_changes
+    static constexpr std::array<std::pair<Flag, std::string_view>, 9> FLAG_NAMES = {{
+        {CF, "CF"},
+        {PF, "PF"},
+        {AF, "AF"},
+        {ZF, "ZF"},
+        {SF, "SF"},
+        {TF, "TF"},
+        {IF, "IF"},
+        {DF, "DF"},
+        {OF, "OF"},
+    }};
+} // namespace
+
 class FlagState {
 private:
     u16 flags = 0;
 
 public:
-    [[nodiscard]] constexpr bool test_flag(Flag f) const noexcept;
+    [[nodiscard]] constexpr bool test_flag(Flag f) const noexcept { return flags & f; }
     void set_flag(Flag f, bool value) noexcept;
 
+    [[nodiscard]] constexpr u16 word() const noexcept { return flags; }
+    void set_word(u16 value) noexcept { flags = value; }
+
     [[nodiscard]] std::string format_changes(FlagState before) const noexcept;
 };
 
@@ -0,0 +1,141 @@
+#pragma once
+
+#include "common.hpp"
+
+#include "alu.hpp"
+#include "instructions.hpp"
+
+#include <array>
+#include <bit>
+#include <cstddef>
+#include <span>
+
+// Superinstructions: the compare-and-branch runs that hot loops are made of, matched on decoded
+// instructions so the runner can execute each run as one step. Only register and immediate
+// operands take part, so a fused run never writes memory (or the code it was decoded from).
+
+namespace sim::fusion {
+
+enum class Kind : u8 {
+    NONE,
+    CMP_JCC,     // cmp r, r/imm; jcc
+    ADD_CMP_JCC, // add r, r/imm; cmp r, r/imm; jcc
+    DEC_JNZ,     // dec r; jnz
+};
+
+namespace {
+    using instructions::Instruction;
+    using instructions::Mnemonic;
+    using Type = instructions::Operand::Type;
+
+    [[nodiscard]] constexpr bool is_conditional_jump(Mnemonic mnemonic) noexcept {
+        return mnemonic >= Mnemonic::JE && mnemonic <= Mnemonic::JNS;
+    }
+
+    // NOTE(louis): prefixes are legal on anything, but nothing real puts them on these
+    [[nodiscard]] constexpr bool is_register_only(const Instruction &inst) noexcept {
+        return inst.dst.type == Type::REGISTER &&
+               (inst.src.type == Type::REGISTER || inst.src.type == Type::IMMEDIATE ||
+                inst.src.type == Type::NONE) &&
+               inst.prefix == instructions::Prefix::NONE && !inst.segment;
+    }
+} // namespace
+
+// How many instructions a run starting with first spans, 0 if it can't start one. This is what
+// decides whether it's worth decoding ahead.
+[[nodiscard]] constexpr std::size_t lookahead(const Instruction &first) noexcept {
+    if (!is_register_only(first))
+        return 0;
+
+    switch (first.mnemonic) {
+    case Mnemonic::CMP:
+    case Mnemonic::DEC:
+        return 2;
+    case Mnemonic::ADD:
+        return 3;
+    default:
+        return 0;
+    }
+}
+
+// Which superinstruction run makes, if any. It has to be exactly lookahead(run[0]) long.
+[[nodiscard]] constexpr Kind match(std::span<const Instruction> run) noexcept {
+    if (run.size() < 2 || run.size() != lookahead(run[0]))
+        return Kind::NONE;
+
+    const Instruction &first = run[0];
+    const Instruction &last = run.back();
+    if (!is_conditional_jump(last.mnemonic))
+        return Kind::NONE;
+
+    switch (first.mnemonic) {
+    case Mnemonic::CMP:
+        return Kind::CMP_JCC;
+    case Mnemonic::DEC:
+        return last.mnemonic == Mnemonic::JNE ? Kind::DEC_JNZ : Kind::NONE;
+    case Mnemonic::ADD:
+        return run[1].mnemonic == Mnemonic::CMP && is_register_only(run[1]) ? Kind::ADD_CMP_JCC
+                                                                            : Kind::NONE;
+    default:
+        return Kind::NONE;
+    }
+}
+
+// A run decoded ahead, kept by the runner under its first instruction's address. kind is NONE
+// when it didn't match, which saves decoding it again.
+struct Superinstruction {
+    Kind kind = Kind::NONE;
+    std::array<Instruction, 3> run;
+    std::size_t count = 0;
+
+    [[nodiscard]] std::span<const Instruction> instructions() const noexcept {
+        return std::span(run).first(count);
+    }
+
+    // Whether memory at address still holds the bytes it was decoded from
+    [[nodiscard]] bool matches(std::span<const u8> memory, u16 address) const noexcept {
+        for (const Instruction &inst : instructions()) {
+            for (const u8 byte : inst.bytes) {
+                if (memory[address++] != byte)
+                    return false;
+            }
+        }
+        return true;
+    }
+};
+
+// Whether jcc is taken after a - b set the flags, worked out from the operands alone
+[[nodiscard]] constexpr bool taken_after_sub(Mnemonic jcc, u16 a, u16 b, bool is_wide) noexcept {
+    const u16 mask = alu::width_mask(is_wide);
+    a &= mask;
+    b &= mask;
+
+    const u16 value = (a - b) & mask;
+    const bool sf = value & alu::sign_bit(is_wide);
+    const bool of = (a ^ b) & (a ^ value) & alu::sign_bit(is_wide);
+
+    switch (jcc) {
+    // clang-format off
+    case Mnemonic::JE:  return value == 0;
+    case Mnemonic::JNE: return value != 0;
+    case Mnemonic::JB:  return a < b;
+    case Mnemonic::JNB: return a >= b;
+    case Mnemonic::JBE: return a <= b;
+    case Mnemonic::JA:  return a > b;
+    case Mnemonic::JL:  return sf != of;
+    case Mnemonic::JNL: return sf == of;
+    case Mnemonic::JLE: return value == 0 || sf != of;
+    case Mnemonic::JG:  return value != 0 && sf == of;
+    case Mnemonic::JS:  return sf;
+    case Mnemonic::JNS: return !sf;
+    case Mnemonic::JO:  return of;
+    case Mnemonic::JNO: return !of;
+    case Mnemonic::JP:  return !(std::popcount(static_cast<u8>(value)) & 1);
+    case Mnemonic::JNP: return std::popcount(static_cast<u8>(value)) & 1;
+    // clang-format on
+    default:
+        return false;
+    }
+}
+
+} // namespace sim::fusion
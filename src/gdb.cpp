@@ -0,0 +1,620 @@
+#include "common.hpp"
+
+#include "gdb.hpp"
+
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <array>
+#include <cerrno>
+#include <charconv>
+#include <csignal>
+#include <cstdint>
+#include <cstring>
+
+namespace sim::gdb {
+
+namespace {
+    // set by SIGIO whenever the connection has something to read
+    volatile std::sig_atomic_t pending_input = 0;
+
+    void on_sigio(int) { pending_input = 1; }
+
+    // stop replies, by the signal gdb shows for them
+    constexpr std::string_view SIGINT_STOP = "S02";
+    constexpr std::string_view SIGILL_STOP = "S04";
+    constexpr std::string_view SIGTRAP_STOP = "S05";
+    constexpr std::string_view EXITED = "W00";
+
+    // i386 layout: eax..edi, eip, eflags, cs ss ds es fs gs, st0..st7, then the x87 control words
+    constexpr int GENERAL_REGISTERS = 16;
+    constexpr int FP_REGISTERS = 8;
+    constexpr int FP_CONTROL_REGISTERS = 8;
+    constexpr int EIP = 8;
+    constexpr int EFLAGS = 9;
+    constexpr int LAST_SEGMENT = 13; // es, after cs ss ds
+
+    // gdb's cs ss ds es as sr numbers
+    constexpr std::array<u8, 4> GDB_SEGMENTS = {
+        registers::CS, registers::SS, registers::DS, registers::ES,
+    };
+
+    constexpr std::size_t MAX_READ = 0x1000;
+
+    constexpr std::string_view TARGET_XML = R"(<?xml version="1.0"?>
+<!DOCTYPE target SYSTEM "gdb-target.dtd">
+<target version="1.0">
+  <architecture>i8086</architecture>
+  <feature name="org.gnu.gdb.i386.core">
+    <flags id="i386_eflags" size="4">
+      <field name="CF" start="0" end="0"/>
+      <field name="PF" start="2" end="2"/>
+      <field name="AF" start="4" end="4"/>
+      <field name="ZF" start="6" end="6"/>
+      <field name="SF" start="7" end="7"/>
+      <field name="TF" start="8" end="8"/>
+      <field name="IF" start="9" end="9"/>
+      <field name="DF" start="10" end="10"/>
+      <field name="OF" start="11" end="11"/>
+    </flags>
+    <reg name="eax" bitsize="32" type="int32" regnum="0"/>
+    <reg name="ecx" bitsize="32" type="int32"/>
+    <reg name="edx" bitsize="32" type="int32"/>
+    <reg name="ebx" bitsize="32" type="int32"/>
+    <reg name="esp" bitsize="32" type="data_ptr"/>
+    <reg name="ebp" bitsize="32" type="data_ptr"/>
+    <reg name="esi" bitsize="32" type="int32"/>
+    <reg name="edi" bitsize="32" type="int32"/>
+    <reg name="eip" bitsize="32" type="code_ptr"/>
+    <reg name="eflags" bitsize="32" type="i386_eflags"/>
+    <reg name="cs" bitsize="32" type="int32"/>
+    <reg name="ss" bitsize="32" type="int32"/>
+    <reg name="ds" bitsize="32" type="int32"/>
+    <reg name="es" bitsize="32" type="int32"/>
+    <reg name="fs" bitsize="32" type="int32"/>
+    <reg name="gs" bitsize="32" type="int32"/>
+    <reg name="st0" bitsize="80" type="i387_ext"/>
+    <reg name="st1" bitsize="80" type="i387_ext"/>
+    <reg name="st2" bitsize="80" type="i387_ext"/>
+    <reg name="st3" bitsize="80" type="i387_ext"/>
+    <reg name="st4" bitsize="80" type="i387_ext"/>
+    <reg name="st5" bitsize="80" type="i387_ext"/>
+    <reg name="st6" bitsize="80" type="i387_ext"/>
+    <reg name="st7" bitsize="80" type="i387_ext"/>
+    <reg name="fctrl" bitsize="32" type="int" group="float"/>
+    <reg name="fstat" bitsize="32" type="int" group="float"/>
+    <reg name="ftag" bitsize="32" type="int" group="float"/>
+    <reg name="fiseg" bitsize="32" type="int" group="float"/>
+    <reg name="fioff" bitsize="32" type="int" group="float"/>
+    <reg name="foseg" bitsize="32" type="int" group="float"/>
+    <reg name="fooff" bitsize="32" type="int" group="float"/>
+    <reg name="fop" bitsize="32" type="int" group="float"/>
+  </feature>
+</target>
+)";
+
+    // byte offset and size of register n in the 'g' reply
+    std::pair<std::size_t, std::size_t> register_slot(std::uint32_t n) noexcept {
+        if (n < GENERAL_REGISTERS)
+            return {n * 4, 4};
+        if (n < GENERAL_REGISTERS + FP_REGISTERS)
+            return {GENERAL_REGISTERS * 4 + (n - GENERAL_REGISTERS) * 10, 10};
+        return {GENERAL_REGISTERS * 4 + FP_REGISTERS * 10 +
+                    (n - GENERAL_REGISTERS - FP_REGISTERS) * 4,
+                4};
+    }
+
+    constexpr char HEX_DIGITS[] = "0123456789abcdef";
+
+    void append_hex(std::string &out, u8 byte) {
+        out += HEX_DIGITS[byte >> 4];
+        out += HEX_DIGITS[byte & 0xF];
+    }
+
+    // little-endian, as gdb expects register contents
+    void append_le(std::string &out, std::uint32_t value, int bytes) {
+        for (int i = 0; i < bytes; i++)
+            append_hex(out, static_cast<u8>(value >> (8 * i)));
+    }
+
+    std::optional<std::uint32_t> parse_hex(std::string_view s) noexcept {
+        std::uint32_t value = 0;
+        const auto [end, ec] = std::from_chars(s.data(), s.data() + s.size(), value, 16);
+        if (ec != std::errc{} || end != s.data() + s.size())
+            return std::nullopt;
+        return value;
+    }
+
+    std::optional<std::uint32_t> parse_le(std::string_view s) noexcept {
+        if (s.size() % 2 != 0 || s.size() > 8)
+            return std::nullopt;
+
+        std::uint32_t value = 0;
+        for (std::size_t i = 0; i < s.size(); i += 2) {
+            const auto byte = parse_hex(s.substr(i, 2));
+            if (!byte)
+                return std::nullopt;
+            value |= *byte << (4 * i);
+        }
+        return value;
+    }
+
+    // "addr,length"
+    std::optional<std::pair<std::uint32_t, std::uint32_t>> parse_range(std::string_view s) {
+        const auto comma = s.find(',');
+        if (comma == std::string_view::npos)
+            return std::nullopt;
+
+        const auto address = parse_hex(s.substr(0, comma));
+        const auto length = parse_hex(s.substr(comma + 1));
+        if (!address || !length)
+            return std::nullopt;
+        return std::pair{*address, *length};
+    }
+
+    u8 checksum(std::string_view s) noexcept {
+        u8 sum = 0;
+        for (const char c : s)
+            sum += static_cast<u8>(c);
+        return sum;
+    }
+
+    bool write_all(int fd, std::string_view s) noexcept {
+        while (!s.empty()) {
+            const ssize_t n = ::send(fd, s.data(), s.size(), MSG_NOSIGNAL);
+            if (n < 0 && errno == EINTR)
+                continue;
+            if (n <= 0)
+                return false;
+            s.remove_prefix(static_cast<std::size_t>(n));
+        }
+        return true;
+    }
+} // namespace
+
+Stub::~Stub() {
+    if (connection >= 0)
+        close(connection);
+    if (listener >= 0)
+        close(listener);
+    if (!unix_path.empty())
+        unlink(unix_path.c_str());
+}
+
+bool Stub::listen(std::string_view address) noexcept {
+    if (address.find('/') != std::string_view::npos) {
+        sockaddr_un addr = {};
+        addr.sun_family = AF_UNIX;
+        if (address.size() >= sizeof(addr.sun_path))
+            return false;
+        std::memcpy(addr.sun_path, address.data(), address.size());
+
+        listener = socket(AF_UNIX, SOCK_STREAM, 0);
+        if (listener < 0)
+            return false;
+
+        unix_path = std::string(address);
+        unlink(unix_path.c_str());
+
+        if (bind(listener, reinterpret_cast<sockaddr *>(&addr), sizeof(addr)) != 0)
+            return false;
+    } else {
+        const auto colon = address.rfind(':');
+        if (colon == std::string_view::npos)
+            return false;
+
+        const std::string host(address.substr(0, colon));
+        const auto port_text = address.substr(colon + 1);
+
+        u16 port = 0;
+        const auto [end, ec] =
+            std::from_chars(port_text.data(), port_text.data() + port_text.size(), port);
+        if (ec != std::errc{} || end != port_text.data() + port_text.size())
+            return false;
+
+        sockaddr_in addr = {};
+        addr.sin_family = AF_INET;
+        addr.sin_port = htons(port);
+        if (host.empty() || host == "localhost")
+            addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        else if (inet_pton(AF_INET, host.c_str(), &addr.sin_addr) != 1)
+            return false;
+
+        listener = socket(AF_INET, SOCK_STREAM, 0);
+        if (listener < 0)
+            return false;
+
+        const int on = 1;
+        setsockopt(listener, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+
+        if (bind(listener, reinterpret_cast<sockaddr *>(&addr), sizeof(addr)) != 0)
+            return false;
+    }
+
+    return ::listen(listener, 1) == 0;
+}
+
+Ending Stub::serve() noexcept {
+    connection = accept(listener, nullptr, nullptr);
+    if (connection < 0)
+        return Ending::FAILED;
+
+    // every reply is a small write followed by a wait for gdb, don't let Nagle sit on it
+    const int on = 1;
+    setsockopt(connection, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+
+    // NOTE(louis): the run loop never touches the socket on its own. SIGIO only sets a flag, and
+    // the loop looks at that flag between blocks.
+    struct sigaction action = {};
+    struct sigaction previous = {};
+    action.sa_handler = on_sigio;
+    sigemptyset(&action.sa_mask);
+    action.sa_flags = SA_RESTART;
+    sigaction(SIGIO, &action, &previous);
+
+    const int socket_flags = fcntl(connection, F_GETFL);
+    fcntl(connection, F_SETOWN, getpid());
+    fcntl(connection, F_SETFL, socket_flags | O_ASYNC);
+
+    const Ending ending = session();
+
+    // the default for SIGIO is to terminate, so stop it coming before handing it back
+    fcntl(connection, F_SETFL, socket_flags);
+    sigaction(SIGIO, &previous, nullptr);
+    return ending;
+}
+
+Ending Stub::session() noexcept {
+    while (const auto packet = receive()) {
+        if (*packet == "QStartNoAckMode") {
+            send("OK");
+            acks = false;
+            continue;
+        }
+
+        if (!packet->empty() && (*packet)[0] == 'D') {
+            send("OK");
+            return Ending::DETACHED;
+        }
+
+        const auto reply = handle(*packet);
+        if (!reply)
+            return Ending::KILLED;
+        if (!send(*reply))
+            return Ending::DISCONNECTED;
+    }
+
+    return Ending::DISCONNECTED;
+}
+
+bool Stub::fill() noexcept {
+    char buffer[4096];
+    for (;;) {
+        const ssize_t n = recv(connection, buffer, sizeof(buffer), 0);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            return false;
+
+        input.append(buffer, static_cast<std::size_t>(n));
+        return true;
+    }
+}
+
+std::optional<std::string> Stub::receive() noexcept {
+    for (;;) {
+        // anything before a '$' is an ack or a stray interrupt
+        const auto start = input.find('$');
+        input.erase(0, start == std::string::npos ? input.size() : start);
+
+        const auto hash = input.find('#');
+        if (hash != std::string::npos && input.size() >= hash + 3) {
+            std::string payload = input.substr(1, hash - 1);
+            const auto sum = parse_hex(std::string_view(input).substr(hash + 1, 2));
+            input.erase(0, hash + 3);
+
+            if (sum && *sum == checksum(payload)) {
+                if (acks)
+                    write_all(connection, "+");
+                return payload;
+            }
+
+            if (acks)
+                write_all(connection, "-");
+            continue;
+        }
+
+        if (!fill())
+            return std::nullopt;
+    }
+}
+
+bool Stub::send(std::string_view payload) noexcept {
+    std::string packet = "$";
+    for (const char c : payload) {
+        if (c == '$' || c == '#' || c == '}' || c == '*') {
+            packet += '}';
+            packet += static_cast<char>(c ^ 0x20);
+        } else {
+            packet += c;
+        }
+    }
+
+    packet += '#';
+    append_hex(packet, checksum(std::string_view(packet).substr(1)));
+
+    for (;;) {
+        if (!write_all(connection, packet))
+            return false;
+        if (!acks)
+            return true;
+
+        // resend on '-', anything else in the way is dropped
+        for (;;) {
+            if (input.empty() && !fill())
+                return false;
+
+            const char c = input.front();
+            input.erase(0, 1);
+            if (c == '+')
+                return true;
+            if (c == '-')
+                break;
+        }
+    }
+}
+
+std::optional<std::string> Stub::handle(std::string_view packet) noexcept {
+    if (packet.empty())
+        return "";
+
+    const auto args = packet.substr(1);
+
+    switch (packet[0]) {
+    case '?':
+        return std::string(SIGTRAP_STOP);
+    case 'g':
+        return read_registers();
+    case 'G':
+        return write_registers(args);
+    case 'm':
+        return read_memory(args);
+    case 'M':
+        return write_memory(args);
+    case 'c':
+        return resume(args, false);
+    case 's':
+        return resume(args, true);
+    case 'Z':
+    case 'z':
+        // software and hardware breakpoints are the same thing here, watchpoints aren't supported
+        if (args.size() > 2 && (args[0] == '0' || args[0] == '1'))
+            return breakpoint(args.substr(2), packet[0] == 'Z');
+        return "";
+    case 'p': {
+        const auto n = parse_hex(args);
+        if (!n || *n >= GENERAL_REGISTERS + FP_REGISTERS + FP_CONTROL_REGISTERS)
+            return "E01";
+
+        const auto [offset, size] = register_slot(*n);
+        return read_registers().substr(offset * 2, size * 2);
+    }
+    case 'P': {
+        const auto equals = args.find('=');
+        const auto n = parse_hex(args.substr(0, equals));
+        if (equals == std::string_view::npos || !n)
+            return "E01";
+
+        if (*n > LAST_SEGMENT)
+            return "OK";
+
+        // rewrite the whole set through G so there's one place that knows the layout
+        auto all = read_registers();
+        const auto value = args.substr(equals + 1);
+        if (value.size() != 8)
+            return "E01";
+        all.replace(*n * 8, 8, value);
+        return write_registers(all);
+    }
+    case 'H':
+        return "OK";
+    case 'k':
+        return std::nullopt;
+    case 'q':
+        if (packet.starts_with("qSupported"))
+            return "PacketSize=4000;qXfer:features:read+;QStartNoAckMode+";
+        if (packet == "qAttached")
+            return "1";
+        if (packet.starts_with("qXfer:features:read:target.xml:"))
+            return target_xml(packet.substr(std::strlen("qXfer:features:read:target.xml:")));
+        return "";
+    default:
+        return "";
+    }
+}
+
+std::string Stub::read_registers() const noexcept {
+    std::string out;
+    const auto &regfile = runner.get_registers();
+
+    for (u8 i = 0; i < registers::REG_NAMES.size(); i++)
+        append_le(out, regfile.read({i, true}), 4);
+
+    append_le(out, runner.get_ip(), 4);
+    append_le(out, runner.get_flags().word(), 4);
+
+    for (u8 segment : GDB_SEGMENTS)
+        append_le(out, regfile.read_segment(segment), 4);
+
+    // fs and gs
+    out.append((GENERAL_REGISTERS - LAST_SEGMENT - 1) * 8, '0');
+    out.append(FP_REGISTERS * 20 + FP_CONTROL_REGISTERS * 8, '0');
+    return out;
+}
+
+std::string Stub::write_registers(std::string_view hex) noexcept {
+    if (hex.size() < (EFLAGS + 1) * 8)
+        return "E01";
+
+    // NOTE(louis): segments are optional, gdb sends everything but older clients may not
+    std::array<std::uint32_t, LAST_SEGMENT + 1> values;
+    const std::size_t count = std::min(values.size(), hex.size() / 8);
+    for (std::size_t i = 0; i < count; i++) {
+        const auto value = parse_le(hex.substr(i * 8, 8));
+        if (!value)
+            return "E01";
+        values[i] = *value;
+    }
+
+    // cs stays 0, same as for the guest itself
+    for (std::size_t i = EFLAGS + 1; i < count; i++) {
+        if (GDB_SEGMENTS[i - EFLAGS - 1] == registers::CS && static_cast<u16>(values[i]) != 0)
+            return "E01";
+    }
+
+    auto &regfile = runner.get_registers();
+    for (u8 i = 0; i < registers::REG_NAMES.size(); i++)
+        regfile.write({i, true}, static_cast<u16>(values[i]));
+
+    for (std::size_t i = EFLAGS + 1; i < count; i++)
+        regfile.write_segment(GDB_SEGMENTS[i - EFLAGS - 1], static_cast<u16>(values[i]));
+
+    runner.set_ip(static_cast<u16>(values[EIP]));
+    runner.get_flags().set_word(static_cast<u16>(values[EFLAGS]));
+    return "OK";
+}
+
+std::string Stub::read_memory(std::string_view args) const noexcept {
+    const auto range = parse_range(args);
+    const auto memory = runner.get_memory();
+    if (!range || range->first >= memory.size())
+        return "E01";
+
+    // short reads are fine, gdb asks again for the rest
+    const std::size_t length =
+        std::min<std::size_t>({range->second, memory.size() - range->first, MAX_READ});
+
+    std::string out;
+    out.reserve(length * 2);
+    for (std::size_t i = 0; i < length; i++)
+        append_hex(out, memory[range->first + i]);
+    return out;
+}
+
+std::string Stub::write_memory(std::string_view args) noexcept {
+    const auto colon = args.find(':');
+    if (colon == std::string_view::npos)
+        return "E01";
+
+    const auto range = parse_range(args.substr(0, colon));
+    const auto data = args.substr(colon + 1);
+    const auto memory = runner.get_memory();
+    if (!range || data.size() != range->second * 2 || range->first > memory.size() ||
+        range->second > memory.size() - range->first)
+        return "E01";
+
+    for (std::size_t i = 0; i < range->second; i++) {
+        const auto byte = parse_hex(data.substr(i * 2, 2));
+        if (!byte)
+            return "E01";
+        memory[range->first + i] = static_cast<u8>(*byte);
+    }
+
+    // the write may have landed in code
+    blocks.clear();
+    return "OK";
+}
+
+std::string Stub::breakpoint(std::string_view args, bool insert) noexcept {
+    const auto range = parse_range(args);
+    if (!range || range->first > 0xFFFF)
+        return "E01";
+
+    if (insert)
+        breakpoints.insert(static_cast<u16>(range->first));
+    else
+        breakpoints.erase(static_cast<u16>(range->first));
+    return "OK";
+}
+
+std::string Stub::target_xml(std::string_view args) const noexcept {
+    const auto range = parse_range(args);
+    if (!range)
+        return "E01";
+    if (range->first >= TARGET_XML.size())
+        return "l";
+
+    const auto chunk = TARGET_XML.substr(range->first, range->second);
+    const bool last = range->first + chunk.size() >= TARGET_XML.size();
+    return (last ? "l" : "m") + std::string(chunk);
+}
+
+bool Stub::interrupted() noexcept {
+    pending_input = 0;
+
+    char buffer[256];
+    const ssize_t n = recv(connection, buffer, sizeof(buffer), MSG_DONTWAIT);
+    if (n == 0)
+        return true; // hung up, stop so the main loop notices
+    if (n > 0)
+        input.append(buffer, static_cast<std::size_t>(n));
+
+    const auto ctrl_c = input.find('\x03');
+    if (ctrl_c == std::string::npos)
+        return false;
+
+    input.erase(ctrl_c, 1);
+    return true;
+}
+
+std::string Stub::resume(std::string_view args, bool single) noexcept {
+    if (!args.empty()) {
+        const auto address = parse_hex(args);
+        if (!address)
+            return "E01";
+        runner.set_ip(static_cast<u16>(*address));
+    }
+
+    // the first instruction always runs, so continuing from a breakpoint doesn't stop on it again
+    if (runner.halted())
+        return std::string(EXITED);
+    if (!runner.step())
+        return std::string(SIGILL_STOP);
+    if (single)
+        return std::string(SIGTRAP_STOP);
+
+    for (;;) {
+        if (runner.halted())
+            return std::string(EXITED);
+        if (pending_input && interrupted())
+            return std::string(SIGINT_STOP);
+
+        const u16 start = runner.get_ip();
+        const auto &block = blocks.at(runner, start);
+
+        if (block.count == 0 || breakpoints.any(start, block.end)) {
+            if (breakpoints.contains(start))
+                return std::string(SIGTRAP_STOP);
+            if (!runner.step())
+                return std::string(SIGILL_STOP);
+            continue;
+        }
+
+        for (u16 i = 0; i < block.count; i++) {
+            if (!runner.step())
+                return std::string(SIGILL_STOP);
+
+            const u16 ip = runner.get_ip();
+            if (ip < start || ip >= block.end)
+                break;
+        }
+    }
+}
+
+} // namespace sim::gdb
@@ -0,0 +1,79 @@
+#pragma once
+
+#include "common.hpp"
+
+#include "debugger.hpp"
+#include "runner.hpp"
+
+#include <optional>
+#include <string>
+#include <string_view>
+
+// GDB remote serial protocol over a local socket, so a stock gdb can attach with
+//
+//   (gdb) set architecture i8086
+//   (gdb) target remote localhost:1234
+//
+// Registers are reported in gdb's i386 layout (what its i8086 architecture uses) with the 16-bit
+// values zero-extended; segment and x87 registers read as zero. Addresses are linear.
+
+namespace sim::gdb {
+
+// How serve() ended
+enum class Ending : u8 {
+    FAILED,       // no connection to serve
+    DETACHED,     // gdb sent D
+    KILLED,       // gdb sent k
+    DISCONNECTED, // the connection dropped, or a reply couldn't be sent
+};
+
+class Stub {
+public:
+    explicit Stub(runner::Runner &runner) noexcept : runner(runner) {}
+    ~Stub();
+    Stub(const Stub &) = delete;
+    Stub &operator=(const Stub &) = delete;
+
+    // "[host]:port" listens on TCP (loopback by default), anything with a '/' on a UNIX socket
+    [[nodiscard]] bool listen(std::string_view address) noexcept;
+
+    // Accepts one connection and serves it until gdb detaches, kills or hangs up. The SIGIO
+    // handler it needs meanwhile is put back the way it was before returning.
+    [[nodiscard]] Ending serve() noexcept;
+
+private:
+    runner::Runner &runner;
+
+    int listener = -1;
+    int connection = -1;
+    std::string unix_path;
+
+    std::string input; // received but not yet consumed
+    bool acks = true;  // until QStartNoAckMode
+
+    debug::AddressSet breakpoints;
+    debug::BlockCache blocks;
+
+    // the packet loop, once the connection is set up
+    [[nodiscard]] Ending session() noexcept;
+
+    [[nodiscard]] std::optional<std::string> receive() noexcept;
+    bool send(std::string_view payload) noexcept;
+    bool fill() noexcept;
+
+    // NOTE(louis): returns nullopt for packets that end the session
+    [[nodiscard]] std::optional<std::string> handle(std::string_view packet) noexcept;
+
+    [[nodiscard]] std::string read_registers() const noexcept;
+    [[nodiscard]] std::string write_registers(std::string_view hex) noexcept;
+    [[nodiscard]] std::string read_memory(std::string_view args) const noexcept;
+    [[nodiscard]] std::string write_memory(std::string_view args) noexcept;
+    [[nodiscard]] std::string breakpoint(std::string_view args, bool insert) noexcept;
+    [[nodiscard]] std::string target_xml(std::string_view args) const noexcept;
+
+    // stop reply for whatever ended the run
+    [[nodiscard]] std::string resume(std::string_view args, bool single) noexcept;
+    [[nodiscard]] bool interrupted() noexcept;
+};
+
+} // namespace sim::gdb
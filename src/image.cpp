@@ -0,0 +1,117 @@
+#include "common.hpp"
+
+#include "image.hpp"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cstring>
+#include <utility>
+
+namespace sim::image {
+
+// NOTE(louis): fresh anonymous pages are zero-filled by the kernel, which is what makes the
+// initial memory deterministic without touching (and committing) all of it up front
+std::optional<GuestMemory> GuestMemory::anonymous() noexcept {
+    void *data = mmap(nullptr, SIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (data == MAP_FAILED)
+        return std::nullopt;
+
+    return GuestMemory(static_cast<u8 *>(data), SIZE, 0, true);
+}
+
+std::optional<GuestMemory> GuestMemory::map_file(const char *path) noexcept {
+    const auto image = SharedImage::open(path);
+    return image ? image->instance() : std::nullopt;
+}
+
+std::optional<GuestMemory> GuestMemory::copy_of(std::span<const u8> image) noexcept {
+    auto memory = anonymous();
+    if (!memory)
+        return std::nullopt;
+
+    memory->image_size = std::min(image.size(), SIZE);
+    if (memory->image_size != 0)
+        std::memcpy(memory->data, image.data(), memory->image_size);
+
+    return memory;
+}
+
+GuestMemory GuestMemory::borrow(std::span<u8> memory, std::size_t image_size) noexcept {
+    assert(memory.size() >= SEGMENT_SIZE && image_size <= memory.size());
+    return GuestMemory(memory.data(), std::min(memory.size(), SIZE), image_size, false);
+}
+
+GuestMemory::GuestMemory(GuestMemory &&other) noexcept
+    : data(std::exchange(other.data, nullptr)), size(std::exchange(other.size, 0)),
+      image_size(std::exchange(other.image_size, 0)), owned(std::exchange(other.owned, false)) {}
+
+GuestMemory &GuestMemory::operator=(GuestMemory &&other) noexcept {
+    if (this != &other) {
+        this->~GuestMemory();
+        data = std::exchange(other.data, nullptr);
+        size = std::exchange(other.size, 0);
+        image_size = std::exchange(other.image_size, 0);
+        owned = std::exchange(other.owned, false);
+    }
+    return *this;
+}
+
+GuestMemory::~GuestMemory() {
+    // one munmap covers the image mapping too, it sits inside the anonymous one
+    if (owned && data)
+        munmap(data, size);
+}
+
+std::optional<SharedImage> SharedImage::open(const char *path) noexcept {
+    const int fd = ::open(path, O_RDONLY);
+    if (fd < 0)
+        return std::nullopt;
+
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+        close(fd);
+        return std::nullopt;
+    }
+
+    return SharedImage(fd, std::min<std::size_t>(st.st_size, GuestMemory::SIZE));
+}
+
+SharedImage::SharedImage(SharedImage &&other) noexcept
+    : fd(std::exchange(other.fd, -1)), size(std::exchange(other.size, 0)) {}
+
+SharedImage &SharedImage::operator=(SharedImage &&other) noexcept {
+    if (this != &other) {
+        this->~SharedImage();
+        fd = std::exchange(other.fd, -1);
+        size = std::exchange(other.size, 0);
+    }
+    return *this;
+}
+
+SharedImage::~SharedImage() {
+    if (fd >= 0)
+        close(fd);
+}
+
+std::optional<GuestMemory> SharedImage::instance() const noexcept {
+    auto memory = GuestMemory::anonymous();
+    if (!memory)
+        return std::nullopt;
+
+    if (size != 0) {
+        // the kernel zeroes the tail of the last page past the end of the file
+        void *mapped = mmap(memory->data, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_FIXED,
+                            fd, 0);
+        if (mapped == MAP_FAILED)
+            return std::nullopt;
+    }
+
+    memory->image_size = size;
+    return memory;
+}
+
+} // namespace sim::image
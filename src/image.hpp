@@ -0,0 +1,74 @@
+#pragma once
+
+#include "common.hpp"
+
+#include <cstddef>
+#include <optional>
+#include <span>
+
+namespace sim::image {
+
+class SharedImage;
+
+// The guest address space, with a program image loaded at address 0 and everything else zeroed.
+//
+// map_file() maps the image MAP_PRIVATE straight over an anonymous mapping, so loading never
+// copies it; pages are only copied if the guest writes to them. borrow() runs in caller-owned
+// memory instead, which must already hold the image.
+class GuestMemory {
+public:
+    // 1MB, the 8086's physical address space. Anything in an image past that isn't mapped.
+    static constexpr std::size_t SIZE = 1 << 20;
+    // what a 16-bit offset reaches, the least a borrowed buffer has to cover
+    static constexpr std::size_t SEGMENT_SIZE = 1 << 16;
+
+    [[nodiscard]] static std::optional<GuestMemory> map_file(const char *path) noexcept;
+    [[nodiscard]] static std::optional<GuestMemory> copy_of(std::span<const u8> image) noexcept;
+    [[nodiscard]] static GuestMemory borrow(std::span<u8> memory, std::size_t image_size) noexcept;
+
+    GuestMemory(GuestMemory &&other) noexcept;
+    GuestMemory &operator=(GuestMemory &&other) noexcept;
+    GuestMemory(const GuestMemory &) = delete;
+    GuestMemory &operator=(const GuestMemory &) = delete;
+    ~GuestMemory();
+
+    [[nodiscard]] std::span<u8> bytes() const noexcept { return {data, size}; }
+    [[nodiscard]] std::span<const u8> image() const noexcept { return {data, image_size}; }
+
+private:
+    friend class SharedImage;
+
+    GuestMemory(u8 *data, std::size_t size, std::size_t image_size, bool owned)
+        : data(data), size(size), image_size(image_size), owned(owned) {}
+
+    [[nodiscard]] static std::optional<GuestMemory> anonymous() noexcept;
+
+    u8 *data = nullptr;
+    std::size_t size = 0;
+    std::size_t image_size = 0;
+    bool owned = false;
+};
+
+// An image file kept open so any number of GuestMemory instances can map it. They all share its
+// pages until they write to one, so each costs only the pages it touches.
+class SharedImage {
+public:
+    [[nodiscard]] static std::optional<SharedImage> open(const char *path) noexcept;
+
+    SharedImage(SharedImage &&other) noexcept;
+    SharedImage &operator=(SharedImage &&other) noexcept;
+    SharedImage(const SharedImage &) = delete;
+    SharedImage &operator=(const SharedImage &) = delete;
+    ~SharedImage();
+
+    // Safe to call from several threads at once
+    [[nodiscard]] std::optional<GuestMemory> instance() const noexcept;
+
+private:
+    SharedImage(int fd, std::size_t size) : fd(fd), size(size) {}
+
+    int fd = -1;
+    std::size_t size = 0;
+};
+
+} // namespace sim::image
@@ -6,15 +6,23 @@
 #include "registers.hpp"
 
 #include <iomanip>
+#include <optional>
 #include <sstream>
 #include <string>
 #include <vector>
 
 namespace sim::instructions {
 
-static constexpr std::array<std::string_view, 24> MNEMONIC_NAMES = {
-    "mov", "add", "sub", "cmp", "je", "jl",  "jle", "jb",  "jbe",  "jp",    "jo",     "js",
-    "jne", "jnl", "jg",  "jnb", "ja", "jnp", "jno", "jns", "loop", "loopz", "loopnz", "jcxz"};
+static constexpr std::array<std::string_view, 81> MNEMONIC_NAMES = {
+    "mov",     "add",     "sub",     "cmp",     "je",      "jl",      "jle",     "jb",      "jbe",
+    "jp",      "jo",      "js",      "jne",     "jnl",     "jg",      "jnb",     "ja",      "jnp",
+    "jno",     "jns",     "loop",    "loopz",   "loopnz",  "jcxz",    "push",    "pop",     "pushf",
+    "popf",    "call",    "ret",     "jmp",     "int",     "int3",    "into",    "iret",    "movsb",
+    "movsw",   "cmpsb",   "cmpsw",   "scasb",   "scasw",   "lodsb",   "lodsw",   "stosb",   "stosw",
+    "cld",     "std",     "adc",     "sbb",     "and",     "or",      "xor",     "test",    "not",
+    "neg",     "inc",     "dec",     "shl",     "shr",     "sar",     "rol",     "ror",     "rcl",
+    "rcr",     "mul",     "imul",    "div",     "idiv",    "xchg",    "lea",     "cbw",     "cwd",
+    "nop",     "clc",     "stc",     "cmc",     "in",      "out",     "cli",     "sti",     "hlt"};
 
 enum Mnemonic : u8 {
     MOV,
@@ -40,11 +48,76 @@ enum Mnemonic : u8 {
     LOOP,
     LOOPZ,
     LOOPNZ,
-    JCXZ
+    JCXZ,
+    PUSH,
+    POP,
+    PUSHF,
+    POPF,
+    CALL,
+    RET,
+    JMP,
+    INT,
+    INT3,
+    INTO,
+    IRET,
+    MOVSB,
+    MOVSW,
+    CMPSB,
+    CMPSW,
+    SCASB,
+    SCASW,
+    LODSB,
+    LODSW,
+    STOSB,
+    STOSW,
+    CLD,
+    STD,
+    ADC,
+    SBB,
+    AND,
+    OR,
+    XOR,
+    TEST,
+    NOT,
+    NEG,
+    INC,
+    DEC,
+    SHL,
+    SHR,
+    SAR,
+    ROL,
+    ROR,
+    RCL,
+    RCR,
+    MUL,
+    IMUL,
+    DIV,
+    IDIV,
+    XCHG,
+    LEA,
+    CBW,
+    CWD,
+    NOP,
+    CLC,
+    STC,
+    CMC,
+    IN,
+    OUT,
+    CLI,
+    STI,
+    HLT
 };
 
+// Jumps, loops, calls, returns and interrupts: anything that can leave ip somewhere other than
+// the next instruction. (DIV/IDIV can too, by faulting, but only exceptionally.)
+[[nodiscard]] constexpr bool ends_block(Mnemonic mnemonic) noexcept {
+    return (mnemonic >= JE && mnemonic <= JCXZ) || (mnemonic >= CALL && mnemonic <= IRET);
+}
+
+enum class Prefix : u8 { NONE, REP, REPNE };
+
 struct Operand {
-    enum class Type { REGISTER, MEMORY, IMMEDIATE, NONE } type;
+    enum class Type { REGISTER, SEGMENT, MEMORY, IMMEDIATE, RELATIVE, NONE } type;
 
     union {
         registers::RegAccess reg_access;
@@ -63,6 +136,17 @@ struct Operand {
         };
     }
 
+    [[nodiscard]] static constexpr Operand segment(u8 sr) {
+        return Operand{
+            .type = Type::SEGMENT,
+            .reg_access =
+                {
+                    .index = sr,
+                    .is_wide = true,
+                },
+        };
+    }
+
     [[nodiscard]] static constexpr Operand effective_address(u8 reg1, u8 reg2 = registers::NONE,
                                                              u16 disp = 0, bool is_wide = true) {
         return Operand{
@@ -72,6 +156,8 @@ struct Operand {
                     .terms = {{reg1, true}, {reg2, true}},
                     .displacement = disp,
                     .is_wide = is_wide,
+                    .segment = reg1 == registers::BP ? registers::SS : registers::DS,
+                    .is_override = false,
                 },
         };
     }
@@ -84,6 +170,8 @@ struct Operand {
                     .terms = {{registers::NONE, true}, {registers::NONE, true}},
                     .displacement = addr,
                     .is_wide = is_wide,
+                    .segment = registers::DS,
+                    .is_override = false,
                 },
         };
     }
@@ -95,6 +183,14 @@ struct Operand {
         };
     }
 
+    // NOTE(louis): displacement is sign-extended to 16 bits, so the target is always ip + disp
+    [[nodiscard]] static constexpr Operand rel(u16 disp) {
+        return Operand{
+            .type = Type::RELATIVE,
+            .immediate = disp,
+        };
+    }
+
     [[nodiscard]] static constexpr Operand none() {
         return Operand{
             .type = Type::NONE,
@@ -102,14 +198,29 @@ struct Operand {
         };
     }
 
+    [[nodiscard]] constexpr bool is_wide() const noexcept {
+        switch (type) {
+        case Type::REGISTER:
+            return reg_access.is_wide;
+        case Type::MEMORY:
+            return mem_access.is_wide;
+        default:
+            return true;
+        }
+    }
+
     [[nodiscard]] static std::string string(const Operand &operand) {
         switch (operand.type) {
         case Type::REGISTER:
             return registers::RegAccess::string(operand.reg_access);
+        case Type::SEGMENT:
+            return std::string(registers::SEGMENT_NAMES[operand.reg_access.index]);
         case Type::MEMORY:
             return mem::MemoryAccess::string(operand.mem_access);
         case Type::IMMEDIATE:
             return std::to_string(operand.immediate);
+        case Type::RELATIVE:
+            return std::to_string(static_cast<s16>(operand.immediate));
         case Type::NONE:
             return "";
         default:
@@ -124,6 +235,63 @@ struct Instruction {
     Operand src;
     size_t address;
     std::vector<u8> bytes;
+    Prefix prefix = Prefix::NONE;
+    // segment override prefix, if any; memory operands already have it folded in
+    std::optional<u8> segment = std::nullopt;
+
+    // NOTE(louis): a memory destination only has an implied size when the source is a register
+    // of the same width, shifts by cl don't count
+    [[nodiscard]] static constexpr bool needs_size(const Instruction &inst) noexcept {
+        if (inst.dst.type != Operand::Type::MEMORY)
+            return false;
+
+        const bool is_shift = inst.mnemonic >= SHL && inst.mnemonic <= RCR;
+        return is_shift || inst.src.type != Operand::Type::REGISTER;
+    }
+
+    // Just the NASM source for the instruction, without address and bytes
+    [[nodiscard]] static std::string assembly(const Instruction &inst) noexcept {
+        std::stringstream ss;
+
+        switch (inst.prefix) {
+        case Prefix::REP: {
+            // NOTE(louis): F3 reads as 'repe' on the instructions that test ZF
+            const bool tests_zf = inst.mnemonic >= CMPSB && inst.mnemonic <= SCASW;
+            ss << (tests_zf ? "repe " : "rep ");
+            break;
+        }
+        case Prefix::REPNE:
+            ss << "repne ";
+            break;
+        case Prefix::NONE:
+            break;
+        }
+
+        // NOTE(louis): an override shows up inside the brackets, string ops don't have any
+        const bool has_memory =
+            inst.dst.type == Operand::Type::MEMORY || inst.src.type == Operand::Type::MEMORY;
+        if (inst.segment && !has_memory)
+            ss << registers::SEGMENT_NAMES[*inst.segment] << ' ';
+
+        ss << MNEMONIC_NAMES[inst.mnemonic];
+
+        if (inst.dst.type == Operand::Type::RELATIVE) {
+            // NASM-style, relative to the start of this instruction
+            int offset = static_cast<s16>(inst.dst.immediate) + static_cast<int>(inst.bytes.size());
+            ss << " $" << (offset >= 0 ? "+" : "") << offset;
+        } else if (inst.dst.type != Operand::Type::NONE) {
+            ss << " ";
+            if (needs_size(inst))
+                ss << (inst.dst.is_wide() ? "word " : "byte ");
+            ss << Operand::string(inst.dst);
+        }
+
+        if (inst.src.type != Operand::Type::NONE) {
+            ss << ", " << Operand::string(inst.src);
+        }
+
+        return ss.str();
+    }
 
     [[nodiscard]] static std::string string(const Instruction &inst) noexcept {
         std::stringstream ss;
@@ -139,12 +307,7 @@ struct Instruction {
             ss << std::string((6 - inst.bytes.size()) * 3, ' ');
         }
 
-        ss << MNEMONIC_NAMES[inst.mnemonic] << " " << Operand::string(inst.dst);
-
-        if (inst.src.type != Operand::Type::NONE) {
-            ss << ", " << Operand::string(inst.src);
-        }
-
+        ss << assembly(inst);
         return ss.str();
     }
 };
@@ -0,0 +1,157 @@
+#include "common.hpp"
+
+#include "io.hpp"
+
+#include <fstream>
+#include <iomanip>
+#include <sstream>
+#include <string>
+
+namespace sim::io {
+
+// One event per line, '#' starts a comment:
+//
+//   <instruction> in <port> <b|w> <value>
+//   <instruction> int <vector> [<cycle>]
+//
+// An interrupt's cycle only matters when it woke a hlt, since the instruction count stands still
+// while the guest sleeps. Logs without one deliver as soon as the instruction count matches.
+
+u16 Recorder::in(u16 port, bool is_wide, Time now) noexcept {
+    const u16 value = device.in(port, is_wide, now);
+    events.push_back(Event{
+        .kind = Event::Kind::IN,
+        .instruction = now.instructions,
+        .port = port,
+        .value = value,
+        .is_wide = is_wide,
+    });
+    return value;
+}
+
+void Recorder::out(u16 port, u16 value, bool is_wide, Time now) noexcept {
+    device.out(port, value, is_wide, now);
+}
+
+std::optional<u8> Recorder::interrupt(Time now) noexcept {
+    const auto vector = device.interrupt(now);
+    if (vector) {
+        events.push_back(Event{
+            .kind = Event::Kind::INTERRUPT,
+            .instruction = now.instructions,
+            .cycle = now.cycles,
+            .value = *vector,
+        });
+    }
+    return vector;
+}
+
+bool Recorder::save(const char *path) const noexcept {
+    std::ofstream file(path);
+    if (!file)
+        return false;
+
+    file << "# sim8086 io log\n" << std::hex << std::setfill('0');
+    for (const auto &event : events) {
+        file << std::dec << event.instruction << std::hex;
+        if (event.kind == Event::Kind::IN) {
+            file << " in 0x" << std::setw(4) << event.port << (event.is_wide ? " w 0x" : " b 0x")
+                 << std::setw(event.is_wide ? 4 : 2) << event.value << '\n';
+        } else {
+            file << " int 0x" << std::setw(2) << event.value << ' ' << std::dec << event.cycle
+                 << '\n';
+        }
+    }
+
+    return static_cast<bool>(file);
+}
+
+std::optional<Replayer> Replayer::load(const char *path) noexcept {
+    std::ifstream file(path);
+    if (!file)
+        return std::nullopt;
+
+    std::vector<Event> events;
+    std::string line;
+    while (std::getline(file, line)) {
+        if (line.empty() || line[0] == '#')
+            continue;
+
+        std::istringstream ss(line);
+        Event event = {};
+        std::string kind;
+        unsigned value = 0;
+
+        ss >> event.instruction >> kind;
+        if (kind == "in") {
+            unsigned port = 0;
+            std::string width;
+            ss >> std::hex >> port >> width >> value;
+
+            event.kind = Event::Kind::IN;
+            event.port = static_cast<u16>(port);
+            event.is_wide = width == "w";
+        } else if (kind == "int") {
+            ss >> std::hex >> value;
+            event.kind = Event::Kind::INTERRUPT;
+            if (!(ss >> std::dec >> event.cycle) && ss.eof())
+                ss.clear(std::ios::eofbit);
+        } else {
+            return std::nullopt;
+        }
+
+        if (!ss || value > 0xFFFF)
+            return std::nullopt;
+
+        event.value = static_cast<u16>(value);
+        events.push_back(event);
+    }
+
+    return Replayer(std::move(events));
+}
+
+u16 Replayer::in(u16 port, bool is_wide, Time now) noexcept {
+    if (!diverged && next < events.size()) {
+        const auto &event = events[next];
+        if (event.kind == Event::Kind::IN && event.instruction == now.instructions &&
+            event.port == port && event.is_wide == is_wide) {
+            next++;
+            return event.value;
+        }
+    }
+
+    if (!diverged)
+        diverged = now.instructions;
+    return is_wide ? 0xFFFF : 0xFF;
+}
+
+std::optional<u8> Replayer::interrupt(Time now) noexcept {
+    if (diverged || next == events.size())
+        return std::nullopt;
+
+    const auto &event = events[next];
+    // anything left over from an earlier instruction was missed
+    if (event.instruction < now.instructions) {
+        diverged = now.instructions;
+        return std::nullopt;
+    }
+
+    if (event.instruction > now.instructions || event.kind != Event::Kind::INTERRUPT ||
+        event.cycle > now.cycles)
+        return std::nullopt;
+
+    next++;
+    return static_cast<u8>(event.value);
+}
+
+std::uint64_t Replayer::wake(Time now) noexcept {
+    if (diverged || next == events.size())
+        return NEVER;
+
+    const auto &event = events[next];
+    if (event.kind != Event::Kind::INTERRUPT || event.instruction != now.instructions)
+        return NEVER;
+    return event.cycle;
+}
+
+} // namespace sim::io
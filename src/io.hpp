@@ -0,0 +1,99 @@
+#pragma once
+
+#include "common.hpp"
+
+#include <cstdint>
+#include <limits>
+#include <optional>
+#include <vector>
+
+// Port-mapped I/O and hardware interrupts, and a log of every input that crossed into the guest
+// so a run can be replayed exactly without the devices that produced it.
+
+namespace sim::io {
+
+// When, in guest time, an access happens
+struct Time {
+    std::uint64_t instructions;
+    std::uint64_t cycles;
+};
+
+// A cycle count that never comes
+inline constexpr std::uint64_t NEVER = std::numeric_limits<std::uint64_t>::max();
+
+// Whatever answers IN and OUT
+class Device {
+public:
+    virtual ~Device() = default;
+
+    [[nodiscard]] virtual u16 in(u16 port, bool is_wide, Time now) noexcept = 0;
+    virtual void out(u16 port, u16 value, bool is_wide, Time now) noexcept = 0;
+
+    // Asked before each instruction while IF is set; a vector returned here is delivered at once
+    [[nodiscard]] virtual std::optional<u8> interrupt(Time) noexcept { return std::nullopt; }
+
+    // Asked while the guest sits in a hlt: the cycle count by which interrupt() might have
+    // something, or NEVER if nothing will ever wake it
+    [[nodiscard]] virtual std::uint64_t wake(Time) noexcept { return NEVER; }
+};
+
+// Nothing attached: reads float high and writes go nowhere
+class OpenBus final : public Device {
+public:
+    [[nodiscard]] u16 in(u16, bool is_wide, Time) noexcept override {
+        return is_wide ? 0xFFFF : 0xFF;
+    }
+    void out(u16, u16, bool, Time) noexcept override {}
+};
+
+struct Event {
+    enum class Kind : u8 { IN, INTERRUPT } kind;
+    std::uint64_t instruction; // instructions retired before it happened
+    std::uint64_t cycle = 0;   // for an interrupt, the cycle count it arrived at
+    u16 port = 0;
+    u16 value = 0; // the value read, or the interrupt vector
+    bool is_wide = false;
+};
+
+// Passes everything through to a device and logs what the guest saw. Writes aren't logged, they
+// follow from the inputs.
+class Recorder final : public Device {
+public:
+    explicit Recorder(Device &device) noexcept : device(device) {}
+
+    [[nodiscard]] u16 in(u16 port, bool is_wide, Time now) noexcept override;
+    void out(u16 port, u16 value, bool is_wide, Time now) noexcept override;
+    [[nodiscard]] std::optional<u8> interrupt(Time now) noexcept override;
+    [[nodiscard]] std::uint64_t wake(Time now) noexcept override { return device.wake(now); }
+
+    [[nodiscard]] const std::vector<Event> &get_events() const noexcept { return events; }
+    [[nodiscard]] bool save(const char *path) const noexcept;
+
+private:
+    Device &device;
+    std::vector<Event> events;
+};
+
+// Feeds a recorded log back in place of the devices. Once the guest asks for something the log
+// doesn't have next, the replay has diverged: reads float high and no more interrupts arrive.
+class Replayer final : public Device {
+public:
+    [[nodiscard]] static std::optional<Replayer> load(const char *path) noexcept;
+    explicit Replayer(std::vector<Event> events) noexcept : events(std::move(events)) {}
+
+    [[nodiscard]] u16 in(u16 port, bool is_wide, Time now) noexcept override;
+    void out(u16, u16, bool, Time) noexcept override {}
+    [[nodiscard]] std::optional<u8> interrupt(Time now) noexcept override;
+    [[nodiscard]] std::uint64_t wake(Time now) noexcept override;
+
+    [[nodiscard]] bool finished() const noexcept { return next == events.size(); }
+    // instruction count at which the guest first asked for something the log didn't have next
+    [[nodiscard]] std::optional<std::uint64_t> divergence() const noexcept { return diverged; }
+
+private:
+    std::vector<Event> events;
+    std::size_t next = 0;
+    std::optional<std::uint64_t> diverged;
+};
+
+} // namespace sim::io
@@ -1,30 +1,425 @@
 #include "common.hpp"
 
+#include "cfg.hpp"
+#include "debugger.hpp"
+#include "decode.hpp"
+#include "devices.hpp"
+#include "gdb.hpp"
+#include "image.hpp"
+#include "instructions.hpp"
+#include "io.hpp"
+#include "perf.hpp"
+#include "profile.hpp"
 #include "runner.hpp"
+#include "stats.hpp"
+#include "sweep.hpp"
 
+#include <array>
 #include <cassert>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
 #include <fstream>
+#include <iomanip>
 #include <iostream>
+#include <optional>
+#include <span>
+#include <string_view>
+#include <sys/resource.h>
+#include <thread>
+#include <utility>
+#include <unistd.h>
 #include <vector>
 
+// Linear sweep as NASM source, so the output can be reassembled and compared against the input.
+// Bytes that don't decode are emitted as data.
+static void disassemble(std::span<const u8> memory) {
+    std::cout << "bits 16\n\n";
+
+    std::size_t address = 0;
+    while (address < memory.size()) {
+        const auto inst = sim::decode::try_decode(memory, address);
+        if (!inst) {
+            std::cout << "db 0x" << std::hex << std::setw(2) << std::setfill('0')
+                      << static_cast<int>(memory[address]) << std::dec << '\n';
+            address++;
+            continue;
+        }
+
+        std::cout << sim::instructions::Instruction::assembly(*inst) << '\n';
+        address += inst->bytes.size();
+    }
+}
+
+// Runs to completion, printing each instruction with the registers and flags it changed
+static void trace(sim::runner::Runner &runner, sim::perf::Instrumentation *instrumentation) {
+    while (!runner.halted()) {
+        const auto regfile_before = runner.get_registers();
+        const auto flags_before = runner.get_flags();
+
+        const auto inst = runner.step();
+        if (!inst) {
+            std::cerr << (runner.left_code_segment() ? "cs can only be 0, stopped at 0x"
+                                                     : "failed to decode instruction at 0x")
+                      << std::hex << runner.get_ip() << std::dec << "\n";
+            break;
+        }
+
+        sim::perf::Scope scope(instrumentation, sim::perf::FORMAT);
+
+        const auto reg_changes = runner.get_registers().format_change(regfile_before);
+        const auto flag_changes = runner.get_flags().format_changes(flags_before);
+
+        std::cout << std::left << std::setw(40) << sim::instructions::Instruction::string(*inst);
+
+        if (!reg_changes.empty()) {
+            std::cout << "| r[" << reg_changes << "]";
+            if (!flag_changes.empty()) {
+                std::cout << ", f[" << flag_changes << "]";
+            }
+        } else if (!flag_changes.empty()) {
+            std::cout << "| f[" << flag_changes << "]";
+        }
+        std::cout << '\n';
+    }
+
+    std::cout << '\n' << runner.get_registers().string();
+}
+
+static constexpr std::array<std::string_view, 6> STOP_REASONS = {
+    "halted", "decode error", "ip limit", "cycle limit", "instruction limit", "code segment",
+};
+
+// Runs every image silently, one summary line each, for checking many small programs at once.
+// With stats, each image also gets a line of JSON there.
+static int batch(const std::vector<const char *> &filenames,
+                 sim::perf::Instrumentation *instrumentation, std::ostream *stats) {
+    const auto start = std::chrono::steady_clock::now();
+    int failures = 0;
+    std::uint64_t instructions = 0;
+
+    for (const char *filename : filenames) {
+        auto memory = sim::image::GuestMemory::map_file(filename);
+        if (!memory) {
+            std::cerr << "Failed to open file: " << filename << '\n';
+            failures++;
+            continue;
+        }
+
+        sim::runner::Runner runner(std::move(*memory));
+        if (instrumentation)
+            runner.attach_instrumentation(*instrumentation);
+
+        std::optional<sim::stats::Stats> image_stats;
+        if (stats)
+            runner.attach_stats(image_stats.emplace());
+
+        runner.analyse();
+        const auto result = runner.run_until({});
+        instructions += result.instructions;
+
+        if (stats)
+            *stats << image_stats->json(filename) << '\n';
+
+        std::cout << filename << ": " << STOP_REASONS[static_cast<int>(result.reason)]
+                  << " at 0x" << std::hex << result.ip << std::dec << ", "
+                  << result.instructions << " instructions, " << result.cycles << " cycles\n";
+
+        if (result.reason == sim::runner::StopReason::DECODE_ERROR)
+            failures++;
+    }
+
+    const double seconds =
+        std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    std::cerr << filenames.size() << " images in " << seconds * 1000 << " ms\n";
+
+    if (instrumentation)
+        std::cerr << instrumentation->report(instructions);
+
+    return failures ? 1 : 0;
+}
+
+// Runs one image for every combination of the swept values, one summary line per run in order
+// and a count of each way they stopped. With stats, each run also gets a line of JSON there.
+static int sweep(const char *filename, const std::vector<sim::sweep::Parameter> &parameters,
+                 const sim::sweep::Options &options, std::ostream *stats) {
+    const auto image = sim::image::SharedImage::open(filename);
+    if (!image) {
+        std::cerr << "Failed to open file: " << filename << '\n';
+        return 1;
+    }
+
+    const auto start = std::chrono::steady_clock::now();
+    int failures = 0;
+    std::array<std::uint64_t, STOP_REASONS.size()> stops = {};
+
+    sim::sweep::run(*image, parameters, options, [&](const sim::sweep::Outcome &outcome) {
+        const auto values = sim::sweep::values(parameters, outcome.run);
+        for (std::size_t i = 0; i < parameters.size(); i++)
+            std::cout << (i ? " " : "") << parameters[i].name() << '=' << values[i];
+        std::cout << (parameters.empty() ? "" : ": ");
+
+        if (!outcome.result) {
+            std::cout << "failed to map the image\n";
+            failures++;
+            return;
+        }
+
+        // NOTE(louis): registers and flags as changes from reset, the way a trace shows them
+        const auto &result = *outcome.result;
+        const auto reg_changes = outcome.registers.format_change({});
+        const auto flag_changes = outcome.flags.format_changes({});
+        std::cout << STOP_REASONS[static_cast<int>(result.reason)] << " at 0x" << std::hex
+                  << result.ip << std::dec << ", " << result.instructions << " instructions, "
+                  << result.cycles << " cycles";
+        if (!reg_changes.empty())
+            std::cout << " | r[" << reg_changes << ']';
+        if (!flag_changes.empty())
+            std::cout << (reg_changes.empty() ? " | " : ", ") << "f[" << flag_changes << ']';
+        std::cout << '\n';
+
+        if (stats)
+            *stats << outcome.stats << '\n';
+
+        stops[static_cast<int>(result.reason)]++;
+        if (result.reason == sim::runner::StopReason::DECODE_ERROR)
+            failures++;
+    });
+
+    const double seconds =
+        std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    std::cerr << sim::sweep::combinations(parameters) << " runs on " << options.threads
+              << " threads in "
+              << seconds * 1000 << " ms, peak rss " << usage.ru_maxrss << " KB\n";
+
+    const char *separator = "";
+    for (std::size_t i = 0; i < stops.size(); i++) {
+        if (stops[i] != 0)
+            std::cerr << std::exchange(separator, ", ") << stops[i] << ' ' << STOP_REASONS[i];
+    }
+    std::cerr << (*separator ? "\n" : "");
+
+    return failures ? 1 : 0;
+}
+
 int main(int argc, char *argv[]) {
-    if (argc < 2) {
-        std::cerr << "Usage: " << argv[0] << " <filename>\n";
+    bool profile = false;
+    bool decode_only = false;
+    bool cfg_only = false;
+    bool batch_mode = false;
+    bool perf = false;
+    bool debug = false;
+    bool screen = false;
+    bool sweep_mode = false;
+    std::vector<sim::sweep::Parameter> parameters;
+    sim::sweep::Options sweep_options;
+    sweep_options.threads = std::max(std::thread::hardware_concurrency(), 1u);
+    const char *script = nullptr;
+    const char *gdb_address = nullptr;
+    const char *record_log = nullptr;
+    const char *replay_log = nullptr;
+    const char *stats_file = nullptr;
+    std::vector<const char *> filenames;
+
+    for (int i = 1; i < argc; i++) {
+        if (std::string_view(argv[i]) == "--profile") {
+            profile = true;
+        } else if (std::string_view(argv[i]) == "--decode") {
+            decode_only = true;
+        } else if (std::string_view(argv[i]) == "--cfg") {
+            cfg_only = true;
+        } else if (std::string_view(argv[i]) == "--batch") {
+            batch_mode = true;
+        } else if (std::string_view(argv[i]) == "--perf") {
+            perf = true;
+        } else if (std::string_view(argv[i]) == "--screen") {
+            screen = true;
+        } else if (std::string_view(argv[i]) == "--debug") {
+            debug = true;
+        } else if (std::string_view(argv[i]) == "--script" && i + 1 < argc) {
+            debug = true;
+            script = argv[++i];
+        } else if (std::string_view(argv[i]) == "--gdb" && i + 1 < argc) {
+            gdb_address = argv[++i];
+        } else if (std::string_view(argv[i]) == "--sweep" && i + 1 < argc) {
+            sweep_mode = true;
+            const auto parameter = sim::sweep::Parameter::parse(argv[++i]);
+            if (!parameter) {
+                std::cerr << "Bad sweep parameter: " << argv[i] << '\n';
+                return 1;
+            }
+            parameters.push_back(*parameter);
+        } else if (std::string_view(argv[i]) == "--threads" && i + 1 < argc) {
+            sweep_options.threads = std::max(std::atoi(argv[++i]), 1);
+        } else if (std::string_view(argv[i]) == "--max-instructions" && i + 1 < argc) {
+            sweep_options.limits.instructions = std::strtoull(argv[++i], nullptr, 0);
+        } else if (std::string_view(argv[i]) == "--max-cycles" && i + 1 < argc) {
+            sweep_options.limits.cycles = std::strtoull(argv[++i], nullptr, 0);
+        } else if (std::string_view(argv[i]) == "--stats" && i + 1 < argc) {
+            stats_file = argv[++i];
+        } else if (std::string_view(argv[i]) == "--record" && i + 1 < argc) {
+            record_log = argv[++i];
+        } else if (std::string_view(argv[i]) == "--replay" && i + 1 < argc) {
+            replay_log = argv[++i];
+        } else {
+            filenames.push_back(argv[i]);
+        }
+    }
+
+    // NOTE(louis): the rest of the single-image options keep state for one run, so a sweep can't
+    // take them
+    const bool single_run_options = profile || perf || screen || record_log || replay_log;
+    if (filenames.empty() || (!batch_mode && filenames.size() > 1) ||
+        (sweep_mode && single_run_options)) {
+        std::cerr << "Usage: " << argv[0]
+                  << " [--profile] [--perf] [--screen] [--stats <json>] <filename>\n"
+                  << "       " << argv[0] << " --decode <filename>\n"
+                  << "       " << argv[0] << " --cfg <filename>\n"
+                  << "       " << argv[0] << " --debug [--script <commands>] <filename>\n"
+                  << "       " << argv[0] << " --gdb <[host]:port | socket path> <filename>\n"
+                  << "       " << argv[0] << " --batch [--perf] [--stats <json>] <filename>...\n"
+                  << "       " << argv[0]
+                  << " --sweep <reg or [address]>=<first>[:<last>]... [--threads <n>]\n"
+                  << "           [--max-instructions <n>] [--max-cycles <n>] [--stats <json>]"
+                  << " <filename>\n"
+                  << "Single-image modes also take --record <io log> or --replay <io log>.\n";
         return 1;
     }
 
-    std::ifstream file(argv[1], std::ios::binary);
-    if (!file) {
-        std::cerr << "Failed to open file: " << argv[1] << '\n';
+    // NOTE(louis): optional since every phase transition reads the counters
+    std::optional<sim::perf::Instrumentation> instrumentation;
+    if (perf)
+        instrumentation.emplace();
+
+    sim::perf::Instrumentation *counters = instrumentation ? &*instrumentation : nullptr;
+
+    std::ofstream stats;
+    if (stats_file) {
+        stats.open(stats_file);
+        if (!stats) {
+            std::cerr << "Failed to open file: " << stats_file << '\n';
+            return 1;
+        }
+    }
+
+    if (batch_mode)
+        return batch(filenames, counters, stats_file ? &stats : nullptr);
+
+    if (sweep_mode) {
+        if (stats_file)
+            sweep_options.stats = filenames.front();
+        return sweep(filenames.front(), parameters, sweep_options, stats_file ? &stats : nullptr);
+    }
+
+    const char *filename = filenames.front();
+    auto memory = sim::image::GuestMemory::map_file(filename);
+    if (!memory) {
+        std::cerr << "Failed to open file: " << filename << '\n';
         return 1;
     }
 
-    std::vector<u8> memory;
+    if (decode_only) {
+        disassemble(memory->image());
+        return 0;
+    }
+
+    if (cfg_only) {
+        const auto code = memory->bytes().first(sim::image::GuestMemory::SEGMENT_SIZE);
+        std::cout << sim::cfg::Graph::build(code, memory->image().size(), 0).dot();
+        return 0;
+    }
+
+    sim::profile::Profiler profiler;
+    std::optional<sim::stats::Stats> image_stats;
+
+    sim::runner::Runner runner(std::move(*memory));
+
+    // NOTE(louis): a replay stands in for the port side only, the display stays mapped
+    sim::devices::Pc pc;
+    pc.attach(runner);
+
+    std::optional<sim::io::Recorder> recorder;
+    std::optional<sim::io::Replayer> replayer;
+
+    if (replay_log) {
+        replayer = sim::io::Replayer::load(replay_log);
+        if (!replayer) {
+            std::cerr << "Failed to read io log: " << replay_log << '\n';
+            return 1;
+        }
+        runner.attach_device(*replayer);
+    } else if (record_log) {
+        recorder.emplace(pc.bus);
+        runner.attach_device(*recorder);
+    }
+
+    int status = 0;
+
+    if (gdb_address) {
+        sim::gdb::Stub stub(runner);
+        if (!stub.listen(gdb_address)) {
+            std::cerr << "Failed to listen on " << gdb_address << '\n';
+            return 1;
+        }
 
-    memory.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+        std::cerr << "waiting for gdb on " << gdb_address << '\n';
+        switch (stub.serve()) {
+        case sim::gdb::Ending::FAILED:
+            std::cerr << "Failed to accept a gdb connection\n";
+            status = 1;
+            break;
+        case sim::gdb::Ending::DISCONNECTED:
+            std::cerr << "gdb went away without detaching\n";
+            status = 1;
+            break;
+        case sim::gdb::Ending::DETACHED:
+        case sim::gdb::Ending::KILLED:
+            break;
+        }
+    } else if (debug) {
+        sim::debug::Debugger debugger(runner, std::cout);
 
-    sim::runner::Runner runner(std::move(memory));
-    runner.run();
+        if (!script) {
+            debugger.session(std::cin, isatty(STDIN_FILENO));
+        } else if (std::ifstream commands(script); commands) {
+            debugger.session(commands, false);
+        } else {
+            std::cerr << "Failed to open file: " << script << '\n';
+            return 1;
+        }
+    } else {
+        if (profile)
+            runner.attach_profiler(profiler);
+        if (counters)
+            runner.attach_instrumentation(*counters);
+        if (stats_file)
+            runner.attach_stats(image_stats.emplace());
+
+        trace(runner, counters);
+
+        if (screen)
+            std::cout << '\n' << pc.cga.render();
+        if (profile)
+            std::cerr << profiler.folded();
+        if (counters)
+            std::cerr << counters->report(runner.get_instructions());
+        if (stats_file)
+            stats << image_stats->json(filename) << '\n';
+    }
+
+    if (recorder && !recorder->save(record_log)) {
+        std::cerr << "Failed to write io log: " << record_log << '\n';
+        return 1;
+    }
+
+    if (replayer && replayer->divergence()) {
+        std::cerr << "replay diverged from the log at instruction " << *replayer->divergence()
+                  << '\n';
+        return 1;
+    }
 
-    return 0;
+    return status;
 }
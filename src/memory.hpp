@@ -4,6 +4,7 @@
 
 #include "registers.hpp"
 
+#include <span>
 #include <string>
 #include <vector>
 
@@ -13,9 +14,17 @@ struct MemoryAccess {
     registers::RegAccess terms[2];
     u16 displacement;
     bool is_wide;
+    // resolved when decoded: ss for bp-based addresses, ds otherwise, unless overridden
+    u8 segment;
+    bool is_override;
 
     [[nodiscard]] static std::string string(const MemoryAccess &access) noexcept {
         std::string result = "[";
+        if (access.is_override) {
+            result += registers::SEGMENT_NAMES[access.segment];
+            result += ':';
+        }
+
         bool needs_plus = false;
 
         for (const auto &term : access.terms) {
@@ -29,11 +38,13 @@ struct MemoryAccess {
             needs_plus = true;
         }
 
-        if (access.displacement || !needs_plus) {
-            if (needs_plus)
-                result += " + ";
-
+        // NOTE(louis): displacements are signed next to a register, a bare one is an address
+        if (!needs_plus) {
             result += std::to_string(access.displacement);
+        } else if (access.displacement) {
+            const s16 disp = static_cast<s16>(access.displacement);
+            result += disp < 0 ? " - " : " + ";
+            result += std::to_string(disp < 0 ? -disp : disp);
         }
 
         result += "]";
@@ -50,13 +61,23 @@ struct MemoryAccess {
 // ODR?
 class MemoryReader {
 public:
-    MemoryReader(const std::vector<u8> &memory, std::size_t address)
+    MemoryReader(std::span<const u8> memory, std::size_t address)
         : memory(memory), start_address(address), current_address(address) {}
 
-    [[nodiscard]] u8 peek_byte() const noexcept { return memory.at(current_address); }
+    // NOTE(louis): single-byte instructions can sit at the very end of memory
+    [[nodiscard]] u8 peek_byte() const noexcept {
+        return current_address < memory.size() ? memory[current_address] : 0;
+    }
 
+    // NOTE(louis): reading past the end yields zeroes and flags the overrun, the decoder then
+    // rejects the truncated instruction instead of throwing out of a noexcept function
     [[nodiscard]] u8 byte() noexcept {
-        u8 byte = memory.at(current_address++);
+        if (current_address >= memory.size()) {
+            overrun = true;
+            return 0;
+        }
+
+        u8 byte = memory[current_address++];
         bytes_read.push_back(byte);
         return byte;
     }
@@ -69,12 +90,14 @@ public:
 
     [[nodiscard]] std::size_t get_start_address() const { return start_address; }
     [[nodiscard]] std::vector<u8> get_bytes_read() const { return bytes_read; }
+    [[nodiscard]] bool has_overrun() const { return overrun; }
 
 private:
-    const std::vector<u8> &memory;
+    std::span<const u8> memory;
     std::vector<u8> bytes_read;
     std::size_t start_address;
     std::size_t current_address;
+    bool overrun = false;
 };
 
 } // namespace sim::mem
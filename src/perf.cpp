@@ -0,0 +1,186 @@
+#include "common.hpp"
+
+#include "perf.hpp"
+
+#include <linux/perf_event.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define SIM_PERF_X86 1
+#else
+#include <chrono>
+#endif
+
+#include <cstring>
+#include <iomanip>
+#include <sstream>
+
+namespace sim::perf {
+
+namespace {
+    constexpr std::array<std::uint64_t, COUNTER_COUNT> CONFIGS = {
+        PERF_COUNT_HW_CPU_CYCLES,
+        PERF_COUNT_HW_INSTRUCTIONS,
+        PERF_COUNT_HW_BRANCH_MISSES,
+        PERF_COUNT_HW_CACHE_MISSES,
+    };
+
+    int open_counter(std::uint64_t config, int group) noexcept {
+        perf_event_attr attr;
+        std::memset(&attr, 0, sizeof(attr));
+        attr.size = sizeof(attr);
+        attr.type = PERF_TYPE_HARDWARE;
+        attr.config = config;
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+
+        return static_cast<int>(syscall(SYS_perf_event_open, &attr, 0, -1, group, 0));
+    }
+
+    std::uint64_t timestamp() noexcept {
+#ifdef SIM_PERF_X86
+        return __rdtsc();
+#else
+        return std::chrono::steady_clock::now().time_since_epoch().count();
+#endif
+    }
+
+    // NOTE(louis): with the counter's page mapped, rdpmc reads it from user space without a
+    // syscall, which matters since this runs several times per guest instruction
+    std::uint64_t read_counter(int fd, void *page) noexcept {
+#ifdef SIM_PERF_X86
+        if (page) {
+            auto *pc = static_cast<volatile perf_event_mmap_page *>(page);
+
+            for (;;) {
+                const std::uint32_t seq = pc->lock;
+                __asm__ volatile("" ::: "memory");
+
+                const std::uint32_t index = pc->index;
+                if (!pc->cap_user_rdpmc || index == 0)
+                    break;
+
+                std::uint64_t count = pc->offset;
+                const unsigned width = pc->pmc_width;
+
+                std::uint64_t pmc = __rdpmc(static_cast<int>(index - 1));
+                pmc <<= 64 - width;
+                count += static_cast<std::uint64_t>(static_cast<std::int64_t>(pmc) >> (64 - width));
+
+                __asm__ volatile("" ::: "memory");
+                if (pc->lock == seq)
+                    return count;
+            }
+        }
+#endif
+
+        std::uint64_t value = 0;
+        if (::read(fd, &value, sizeof(value)) != sizeof(value))
+            return 0;
+        return value;
+    }
+} // namespace
+
+Instrumentation::Instrumentation() noexcept {
+    fds.fill(-1);
+
+    // all or nothing: a partial set would make the per-phase numbers inconsistent
+    for (std::size_t i = 0; i < COUNTER_COUNT; i++) {
+        fds[i] = open_counter(CONFIGS[i], i == 0 ? -1 : fds[0]);
+        if (fds[i] < 0) {
+            for (std::size_t j = 0; j < i; j++) {
+                close(fds[j]);
+                fds[j] = -1;
+            }
+            break;
+        }
+    }
+
+    if (has_hardware_counters()) {
+        for (std::size_t i = 0; i < COUNTER_COUNT; i++) {
+            void *page = mmap(nullptr, sysconf(_SC_PAGESIZE), PROT_READ, MAP_SHARED, fds[i], 0);
+            pages[i] = page == MAP_FAILED ? nullptr : page;
+        }
+    }
+
+    last = read();
+}
+
+Instrumentation::~Instrumentation() {
+    for (std::size_t i = 0; i < COUNTER_COUNT; i++) {
+        if (pages[i])
+            munmap(pages[i], sysconf(_SC_PAGESIZE));
+        if (fds[i] >= 0)
+            close(fds[i]);
+    }
+}
+
+Sample Instrumentation::read() const noexcept {
+    Sample sample = {};
+
+    if (!has_hardware_counters()) {
+        sample[CYCLES] = timestamp();
+        return sample;
+    }
+
+    for (std::size_t i = 0; i < COUNTER_COUNT; i++)
+        sample[i] = read_counter(fds[i], pages[i]);
+    return sample;
+}
+
+void Instrumentation::charge() noexcept {
+    const Sample now = read();
+
+    auto &total = totals[stack[depth]];
+    for (std::size_t i = 0; i < COUNTER_COUNT; i++)
+        total[i] += now[i] - last[i];
+
+    last = now;
+}
+
+std::string Instrumentation::report(std::uint64_t guest_instructions) const noexcept {
+    std::stringstream ss;
+    ss << std::fixed << std::setprecision(2);
+
+    const double n = guest_instructions ? static_cast<double>(guest_instructions) : 1.0;
+    const bool hardware = has_hardware_counters();
+
+    std::uint64_t all_cycles = 0;
+    for (std::size_t phase = 0; phase < PHASE_COUNT; phase++)
+        all_cycles += totals[phase][CYCLES];
+
+    ss << std::left << std::setw(10) << "phase" << std::right << std::setw(14) << "cycles/instr"
+       << std::setw(8) << "share";
+    if (hardware)
+        ss << std::setw(8) << "IPC" << std::setw(16) << "br-miss/instr" << std::setw(18)
+           << "cache-miss/instr";
+    ss << '\n';
+
+    for (std::size_t phase = 0; phase < PHASE_COUNT; phase++) {
+        const Sample &total = totals[phase];
+        const double share = all_cycles ? 100.0 * total[CYCLES] / all_cycles : 0.0;
+
+        ss << std::left << std::setw(10) << PHASE_NAMES[phase] << std::right << std::setw(14)
+           << total[CYCLES] / n << std::setw(7) << share << '%';
+
+        if (hardware) {
+            const double ipc =
+                total[CYCLES] ? static_cast<double>(total[INSTRUCTIONS]) / total[CYCLES] : 0.0;
+            ss << std::setw(8) << ipc << std::setw(16) << total[BRANCH_MISSES] / n
+               << std::setw(18) << total[CACHE_MISSES] / n;
+        }
+        ss << '\n';
+    }
+
+    ss << std::left << std::setw(10) << "total" << std::right << std::setw(14) << all_cycles / n
+       << '\n';
+    ss << guest_instructions << " guest instructions, "
+       << (hardware ? "perf_event counters" : "rdtsc (perf_event_open unavailable)") << '\n';
+
+    return ss.str();
+}
+
+} // namespace sim::perf
@@ -0,0 +1,101 @@
+#pragma once
+
+#include "common.hpp"
+
+#include <array>
+#include <cstdint>
+#include <string>
+
+// Host-side cost of each simulator phase, from hardware counters via perf_event_open when the
+// kernel allows it and from the timestamp counter otherwise.
+
+namespace sim::perf {
+
+enum Phase : u8 {
+    DECODE,
+    OPERANDS,
+    EXECUTE,
+    FORMAT,
+    PHASE_COUNT,
+};
+
+static constexpr std::array<const char *, PHASE_COUNT> PHASE_NAMES = {
+    "decode",
+    "operands",
+    "execute",
+    "format",
+};
+
+enum Counter : u8 {
+    CYCLES,
+    INSTRUCTIONS,
+    BRANCH_MISSES,
+    CACHE_MISSES,
+    COUNTER_COUNT,
+};
+
+using Sample = std::array<std::uint64_t, COUNTER_COUNT>;
+
+// NOTE(louis): phases nest (operand reads happen inside execute), so counts go to whichever
+// phase is innermost. Each transition reads the counters once and charges the delta since the
+// previous transition to the phase that was active.
+class Instrumentation {
+public:
+    Instrumentation() noexcept;
+    ~Instrumentation();
+    Instrumentation(const Instrumentation &) = delete;
+    Instrumentation &operator=(const Instrumentation &) = delete;
+
+    void enter(Phase phase) noexcept {
+        assert(depth + 1 < stack.size());
+        charge();
+        stack[++depth] = phase;
+    }
+
+    void leave() noexcept {
+        charge();
+        depth--;
+    }
+
+    // true when the counters come from perf_event_open, otherwise only CYCLES is populated
+    [[nodiscard]] bool has_hardware_counters() const noexcept { return fds[CYCLES] >= 0; }
+
+    // cycles (and, with hardware counters, IPC and misses) per guest instruction for each phase
+    [[nodiscard]] std::string report(std::uint64_t guest_instructions) const noexcept;
+
+private:
+    void charge() noexcept;
+    [[nodiscard]] Sample read() const noexcept;
+
+    std::array<int, COUNTER_COUNT> fds;
+    std::array<void *, COUNTER_COUNT> pages = {};
+
+    std::array<Sample, PHASE_COUNT + 1> totals = {}; // the last slot is time outside any phase
+    Sample last = {};
+
+    std::array<u8, 16> stack = {PHASE_COUNT};
+    std::size_t depth = 0;
+};
+
+// Scoped phase, free when instrumentation is off
+class Scope {
+public:
+    Scope(Instrumentation *instrumentation, Phase phase) noexcept
+        : instrumentation(instrumentation) {
+        if (instrumentation)
+            instrumentation->enter(phase);
+    }
+
+    ~Scope() {
+        if (instrumentation)
+            instrumentation->leave();
+    }
+
+    Scope(const Scope &) = delete;
+    Scope &operator=(const Scope &) = delete;
+
+private:
+    Instrumentation *instrumentation;
+};
+
+} // namespace sim::perf
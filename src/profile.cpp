@@ -0,0 +1,81 @@
+#include "common.hpp"
+
+#include "profile.hpp"
+
+#include <algorithm>
+#include <iomanip>
+#include <sstream>
+#include <string>
+#include <vector>
+
+namespace sim::profile {
+
+void Profiler::enter(u16 target) noexcept {
+    const std::uint32_t key = (current << 16) | target;
+
+    auto it = children.find(key);
+    if (it == children.end()) {
+        nodes.push_back(Node{current, target, 0});
+        it = children.emplace(key, static_cast<std::uint32_t>(nodes.size() - 1)).first;
+    }
+
+    current = it->second;
+}
+
+void Profiler::leave() noexcept {
+    // NOTE(louis): returning past the entry point just keeps attributing to the root
+    current = nodes[current].parent;
+}
+
+std::string Profiler::folded() const noexcept {
+    std::stringstream ss;
+    std::vector<u16> stack;
+
+    for (std::uint32_t i = 0; i < nodes.size(); i++) {
+        if (nodes[i].samples == 0)
+            continue;
+
+        stack.clear();
+        for (std::uint32_t node = i; node != 0; node = nodes[node].parent) {
+            stack.push_back(nodes[node].target);
+        }
+        std::reverse(stack.begin(), stack.end());
+
+        ss << "entry";
+        for (u16 target : stack) {
+            ss << ";0x" << std::hex << std::setfill('0') << std::setw(4) << target;
+        }
+        ss << " " << std::dec << nodes[i].samples << "\n";
+    }
+
+    return ss.str();
+}
+
+void CallStack::call(u16 target, u16 return_address) noexcept {
+    frames.push_back(Frame{target, return_address});
+    deepest = std::max(deepest, frames.size());
+
+    if (profiler)
+        profiler->enter(target);
+}
+
+void CallStack::ret(u16 return_address) noexcept {
+    // NOTE(louis): unwind to the frame being returned to, so a longjmp-style return pops every
+    // frame it skips. A ret that matches no frame (e.g. 'push addr; ret') is really a jump.
+    auto it = std::find_if(frames.rbegin(), frames.rend(), [&](const Frame &frame) {
+        return frame.return_address == return_address;
+    });
+
+    if (it == frames.rend())
+        return;
+
+    const std::size_t remaining = frames.rend() - it - 1;
+    while (frames.size() > remaining) {
+        frames.pop_back();
+
+        if (profiler)
+            profiler->leave();
+    }
+}
+
+} // namespace sim::profile
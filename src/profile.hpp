@@ -0,0 +1,57 @@
+#pragma once
+
+#include "common.hpp"
+
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace sim::profile {
+
+// Instruction counts attributed to the call stack they were executed under. Each distinct stack
+// is a node in a call tree, so sampling is a single increment on the current node.
+class Profiler {
+public:
+    void enter(u16 target) noexcept;
+    void leave() noexcept;
+    void sample() noexcept { nodes[current].samples++; }
+
+    // one "entry;0x0010;0x0024 <count>" line per stack, as consumed by flamegraph.pl
+    [[nodiscard]] std::string folded() const noexcept;
+
+private:
+    struct Node {
+        std::uint32_t parent;
+        u16 target;
+        std::uint64_t samples;
+    };
+
+    std::vector<Node> nodes = {{0, 0, 0}};
+    std::unordered_map<std::uint32_t, std::uint32_t> children; // (parent << 16 | target) -> node
+    std::uint32_t current = 0;
+};
+
+class CallStack {
+public:
+    struct Frame {
+        u16 target;
+        u16 return_address;
+    };
+
+    void call(u16 target, u16 return_address) noexcept;
+    void ret(u16 return_address) noexcept;
+
+    void attach(Profiler *p) noexcept { profiler = p; }
+
+    [[nodiscard]] std::size_t depth() const noexcept { return frames.size(); }
+    [[nodiscard]] std::size_t max_depth() const noexcept { return deepest; }
+    [[nodiscard]] const std::vector<Frame> &get_frames() const noexcept { return frames; }
+
+private:
+    std::vector<Frame> frames;
+    std::size_t deepest = 0;
+    Profiler *profiler = nullptr;
+};
+
+} // namespace sim::profile
@@ -15,7 +15,7 @@ u16 RegFile::read(RegAccess access) const noexcept {
     }
 
     const u8 *bytes = reinterpret_cast<const u8 *>(regs.data());
-    return bytes[2 * (access.index & 0b11) + ((access.is_wide) ? 0 : 1)] & 0xFF;
+    return bytes[2 * (access.index & 0b11) + ((access.index & 0b100) ? 1 : 0)] & 0xFF;
 }
 
 void RegFile::write(RegAccess access, u16 value) noexcept {
@@ -23,17 +23,15 @@ void RegFile::write(RegAccess access, u16 value) noexcept {
         regs[access.index] = value;
     } else {
         u8 *bytes = reinterpret_cast<u8 *>(regs.data());
-        bytes[2 * (access.index & 0b11) + ((access.is_wide) ? 0 : 1)] = value & 0xFF;
+        bytes[2 * (access.index & 0b11) + ((access.index & 0b100) ? 1 : 0)] = value & 0xFF;
     }
-
-    recent_write = access;
 }
 
 std::string RegFile::string() const noexcept {
     std::stringstream ss;
     ss << std::left << std::setw(2);
 
-    for (size_t i = 0; i < regs.size(); i++) {
+    for (size_t i = 0; i < REG_NAMES.size(); i++) {
         if (regs[i] == 0)
             continue;
 
@@ -42,7 +40,24 @@ std::string RegFile::string() const noexcept {
         ss << std::right << std::hex << std::uppercase << std::setfill('0') << std::setw(4);
         ss << static_cast<u16>(regs[i]);
 
-        if (i != regs.size() - 1)
+        if (i != REG_NAMES.size() - 1)
+            ss << "\n";
+    }
+
+    // NOTE(louis): segments only show up once something loads them, like the other registers
+    bool first = true;
+    for (size_t i = 0; i < segments.size(); i++) {
+        if (segments[i] == 0)
+            continue;
+
+        if (first && regs[DI] != 0)
+            ss << "\n";
+        first = false;
+
+        ss << SEGMENT_NAMES[i] << ": 0x";
+        ss << std::right << std::hex << std::uppercase << std::setfill('0') << std::setw(4);
+        ss << segments[i];
+        if (i != segments.size() - 1)
             ss << "\n";
     }
 
@@ -50,25 +65,31 @@ std::string RegFile::string() const noexcept {
 }
 
 std::string RegFile::format_change(const RegFile &before) const noexcept {
-    const bool same_index = recent_write.index == before.recent_write.index;
-    const bool both_wide = recent_write.is_wide && before.recent_write.is_wide;
-    const bool equal_values = regs[recent_write.index] == before.regs[before.recent_write.index];
+    std::stringstream ss;
+
+    // NOTE(louis): MUL/DIV/XCHG and the string ops write several registers, so report every
+    // register that differs rather than just the last one written
+    for (std::size_t i = 0; i < REG_NAMES.size(); i++) {
+        if (regs[i] == before.regs[i])
+            continue;
 
-    if (same_index && both_wide && equal_values)
-        return "";
+        if (ss.tellp() > 0)
+            ss << ", ";
 
-    std::stringstream ss;
+        ss << REG_NAMES[i] << " -> ";
+        ss << "0x" << std::hex << std::uppercase << regs[i];
+        ss << " (" << std::dec << static_cast<s16>(regs[i]) << ")";
+    }
+
+    for (std::size_t i = 0; i < segments.size(); i++) {
+        if (segments[i] == before.segments[i])
+            continue;
 
-    ss << RegAccess::string(recent_write) << " -> ";
-    ss << "0x" << std::hex << std::uppercase << regs[recent_write.index];
+        if (ss.tellp() > 0)
+            ss << ", ";
 
-    ss << " (" << std::dec;
-    if (recent_write.is_wide) {
-        ss << static_cast<s16>(read(recent_write));
-    } else {
-        ss << static_cast<s8>(read(recent_write));
+        ss << SEGMENT_NAMES[i] << " -> 0x" << std::hex << std::uppercase << segments[i];
     }
-    ss << ")";
 
     return ss.str();
 }
@@ -3,6 +3,7 @@
 #include "common.hpp"
 
 #include <array>
+#include <cstdint>
 #include <string>
 #include <string_view>
 
@@ -13,6 +14,7 @@ namespace {
     };
     static constexpr std::array<std::string_view, 4> REG_NAMES_HIGH = {"ah", "ch", "dh", "bh"};
     static constexpr std::array<std::string_view, 4> REG_NAMES_LOW = {"al", "cl", "dl", "bl"};
+    static constexpr std::array<std::string_view, 4> SEGMENT_NAMES = {"es", "cs", "ss", "ds"};
 } // namespace
 
 enum RegIndex : u8 {
@@ -27,6 +29,14 @@ enum RegIndex : u8 {
     NONE,
 };
 
+// In the order the sr field of MOV/PUSH/POP and the override prefixes encode them
+enum SegmentIndex : u8 {
+    ES = 0,
+    CS,
+    SS,
+    DS,
+};
+
 static constexpr std::array<std::pair<u8, u8>, 8> EFFECTIVE_ADDRESSES = {{
     {BX, SI},
     {BX, DI},
@@ -54,15 +64,28 @@ struct RegAccess {
 
 class RegFile {
 private:
-    std::array<u16, 8> regs = {};
-    RegAccess recent_write; // for formatting change
+    // NOTE(louis): the slot behind NONE is never written, so a missing address term reads as 0
+    std::array<u16, NONE + 1> regs = {};
+    std::array<u16, 4> segments = {};
+    // segment << 4, only recomputed when a segment register is written
+    std::array<std::uint32_t, 4> bases = {};
 
 public:
     [[nodiscard]] u16 read(RegAccess access) const noexcept;
     void write(RegAccess access, u16 value) noexcept;
 
+    // Wide read that also accepts NONE, for effective addresses
+    [[nodiscard]] u16 read_term(u8 index) const noexcept { return regs[index]; }
+
+    [[nodiscard]] u16 read_segment(u8 index) const noexcept { return segments[index]; }
+    [[nodiscard]] std::uint32_t segment_base(u8 index) const noexcept { return bases[index]; }
+    void write_segment(u8 index, u16 value) noexcept {
+        segments[index] = value;
+        bases[index] = std::uint32_t{value} << 4;
+    }
+
     [[nodiscard]] std::string string() const noexcept;
-    [[nodiscard]] std::string format_change(const RegFile &before) noexcept;
+    [[nodiscard]] std::string format_change(const RegFile &before) const noexcept;
 };
 
 } // namespace sim::registers
@@ -1,65 +1,460 @@
 #include "common.hpp"
 
+#include "alu.hpp"
 #include "decode.hpp"
+#include "fusion.hpp"
 #include "instructions.hpp"
 #include "registers.hpp"
 #include "runner.hpp"
+#include "timing.hpp"
 
-#include <iostream>
+#include <algorithm>
+#include <cstring>
 
 namespace sim::runner {
 
-void Runner::run() noexcept {
-    // NOTE(louis): This is inefficient, trying the whole table until we get a hit.
-    // We could pre-compute a jump table or something, but I want to move onto another project :)
-    while (ip < instruction_memory.size()) {
-        const auto inst_optional = decode::try_decode(instruction_memory, ip);
-        if (!inst_optional) {
-            std::cerr << "failed to decode instruction at 0x" << std::hex << ip << "\n";
-            break;
+std::optional<instructions::Instruction> Runner::step() noexcept {
+    left_segment = false;
+
+    // only still waiting if run_until stopped partway through a hlt
+    sleep(io::NEVER);
+    if (asleep || left_segment)
+        return std::nullopt;
+
+    poll_interrupts();
+    if (left_segment)
+        return std::nullopt;
+
+    auto inst = fetch();
+    if (inst) {
+        retire(*inst);
+        if (left_segment)
+            return std::nullopt;
+        sleep(io::NEVER);
+    }
+    return inst;
+}
+
+RunResult Runner::run_until(const Limits &limits) noexcept {
+    left_segment = false;
+    deferring = true;
+    auto stop = [&](StopReason reason) {
+        deferring = false;
+        settle_flags();
+        return RunResult{
+            .reason = reason,
+            .ip = ip,
+            .instructions = instruction_count,
+            .cycles = cycle_count,
+        };
+    };
+
+    // NOTE(louis): conditions are checked before each instruction, so a runner already sitting on
+    // the ip limit returns straight away; step() past it first to resume
+    for (;;) {
+        // a hlt goes to sleep before anything is checked, as it does at the end of step()
+        sleep(limits.cycles.value_or(io::NEVER));
+        if (left_segment)
+            return stop(StopReason::CODE_SEGMENT);
+        if (halted())
+            return stop(StopReason::HALTED);
+        if (limits.ip && ip == *limits.ip)
+            return stop(StopReason::IP);
+        if (limits.cycles && cycle_count >= *limits.cycles)
+            return stop(StopReason::CYCLES);
+        if (limits.instructions && instruction_count >= *limits.instructions)
+            return stop(StopReason::INSTRUCTIONS);
+
+        poll_interrupts();
+        if (left_segment)
+            return stop(StopReason::CODE_SEGMENT);
+
+        // NOTE(louis): fused runs skip the per-instruction interrupt poll and profiler sample, so
+        // they're off whenever either could see the difference
+        const bool can_fuse =
+            !profiler && !statistics && !(device && flags.test_flag(flags::Flag::IF));
+        const fusion::Superinstruction *cached = can_fuse ? cached_fusion() : nullptr;
+        if (cached && cached->kind != fusion::Kind::NONE && run_fused(*cached, limits))
+            continue;
+
+        const auto inst = fetch();
+        if (!inst)
+            return stop(StopReason::DECODE_ERROR);
+
+        // NOTE(louis): only decode ahead the first time, after that ip's entry says how it went
+        if (can_fuse && !cached && fusion::lookahead(*inst)) {
+            if (const auto *fused = fuse(*inst);
+                fused->kind != fusion::Kind::NONE && run_fused(*fused, limits))
+                continue;
         }
 
-        const auto &inst = inst_optional.value();
-        ip += inst.bytes.size();
+        retire(*inst);
+    }
+}
 
-        const auto regfile_before = regfile;
-        const auto flags_before = flags;
+void Runner::poll_interrupts() noexcept {
+    // NOTE(louis): hardware interrupts are only taken between instructions, and not straight
+    // after a write to ss so that the sp load that normally follows can't be split from it
+    const bool shadowed = std::exchange(interrupt_shadow, false);
+    if (device && !shadowed && flags.test_flag(flags::Flag::IF)) {
+        if (const auto vector = device->interrupt({instruction_count, cycle_count})) {
+            settle_flags();
+            interrupt(*vector);
+            if (left_segment)
+                return;
+            cycle_count += timing::HARDWARE_INTERRUPT;
+            waiting = false;
+        }
+    }
+}
+
+void Runner::sleep(std::uint64_t until) noexcept {
+    while (waiting && cycle_count < until) {
+        poll_interrupts();
+        if (!waiting || left_segment)
+            return;
+
+        const std::uint64_t wake = device && flags.test_flag(flags::Flag::IF)
+                                       ? device->wake({instruction_count, cycle_count})
+                                       : io::NEVER;
+        if (wake == io::NEVER) {
+            asleep = true;
+            return;
+        }
+        cycle_count = std::min(std::max(wake, cycle_count + 1), until);
+    }
+}
 
+std::optional<instructions::Instruction> Runner::fetch() const noexcept {
+    perf::Scope scope(instrumentation, perf::DECODE);
+    return decode::try_decode(memory, ip);
+}
+
+void Runner::retire(const instructions::Instruction &inst) noexcept {
+    if (lazy_flags && (cfg::flags_read(inst) & lazy_flags->affected))
+        settle_flags();
+
+    registers::RegAccess cx{registers::CX, true};
+    const u16 cx_before = regfile.read(cx);
+    const u16 next = ip + inst.bytes.size();
+    ip = next;
+
+    if (profiler)
+        profiler->sample();
+
+    {
+        perf::Scope scope(instrumentation, perf::EXECUTE);
         execute_instruction(inst);
+    }
 
-        const auto reg_changes = regfile.format_change(regfile_before);
-        const auto flag_changes = flags.format_changes(flags_before);
+    if (left_segment) {
+        ip = inst.address;
+        return;
+    }
+
+    // REP counts and CL shift counts are only known once the instruction has run
+    std::uint32_t repetitions = 0;
+    if (inst.prefix != instructions::Prefix::NONE) {
+        repetitions = static_cast<u16>(cx_before - regfile.read(cx));
+    } else if (inst.src.type == instructions::Operand::Type::REGISTER &&
+               inst.mnemonic >= instructions::Mnemonic::SHL &&
+               inst.mnemonic <= instructions::Mnemonic::RCR) {
+        repetitions = cx_before & 0xFF;
+    }
 
-        std::cout << std::left << std::setw(40) << instructions::Instruction::string(inst);
+    if (statistics)
+        statistics->retire(inst, ip != next);
+
+    instruction_count++;
+    cycle_count += timing::estimate(inst, ip != next, repetitions);
+}
 
-        if (!reg_changes.empty()) {
-            std::cout << "| r[" << reg_changes << "]";
-            if (!flag_changes.empty()) {
-                std::cout << ", f[" << flag_changes << "]";
-            }
+const fusion::Superinstruction *Runner::cached_fusion() noexcept {
+    const auto it = superinstructions.find(ip);
+    if (it == superinstructions.end())
+        return nullptr;
+
+    if (!it->second.matches(memory, ip)) {
+        superinstructions.erase(it);
+        return nullptr;
+    }
+    return &it->second;
+}
+
+const fusion::Superinstruction *Runner::fuse(const instructions::Instruction &first) noexcept {
+    fusion::Superinstruction fused;
+    fused.run[0] = first;
+    fused.count = 1;
+
+    u16 address = ip + first.bytes.size();
+    while (fused.count < fusion::lookahead(first)) {
+        std::optional<instructions::Instruction> inst;
+        {
+            perf::Scope scope(instrumentation, perf::DECODE);
+            inst = decode::try_decode(memory, address);
         }
-        std::cout << '\n';
+        if (!inst)
+            break;
+
+        address += inst->bytes.size();
+        fused.run[fused.count++] = std::move(*inst);
     }
 
-    std::cout << '\n' << regfile.string();
+    fused.kind = fusion::match(fused.instructions());
+    return &(superinstructions[ip] = std::move(fused));
+}
+
+bool Runner::run_fused(const fusion::Superinstruction &fused, const Limits &limits) noexcept {
+    using instructions::Instruction;
+
+    const auto run = fused.instructions();
+
+    // every instruction after the first has to be one run_until would have let through
+    u16 address = ip;
+    std::uint64_t cycles = cycle_count;
+    for (std::size_t i = 1; i < run.size(); i++) {
+        address += run[i - 1].bytes.size();
+        cycles += timing::estimate(run[i - 1], false, 0);
+        if (address >= guest.image().size() || (limits.ip && address == *limits.ip) ||
+            (limits.cycles && cycles >= *limits.cycles) ||
+            (limits.instructions && instruction_count + i >= *limits.instructions))
+            return false;
+    }
+    address += run.back().bytes.size();
+
+    perf::Scope scope(instrumentation, perf::EXECUTE);
+
+    const Instruction &jcc = run.back();
+    const Instruction &cmp = run[run.size() - 2];
+    bool taken = false;
+
+    switch (fused.kind) {
+    case fusion::Kind::ADD_CMP_JCC: {
+        // the add's flags are all overwritten by the cmp, so only its result is needed
+        const Instruction &add = run[0];
+        regfile.write(add.dst.reg_access,
+                      regfile.read(add.dst.reg_access) + read_operand(add.src));
+        [[fallthrough]];
+    }
+
+    case fusion::Kind::CMP_JCC: {
+        const bool is_wide = cmp.dst.is_wide();
+        const u16 a = regfile.read(cmp.dst.reg_access);
+        const u16 b = read_operand(cmp.src);
+
+        taken = fusion::taken_after_sub(jcc.mnemonic, a, b, is_wide);
+        defer_flags({a, b, false, false, is_wide, alu::ARITHMETIC_FLAGS});
+        break;
+    }
+
+    case fusion::Kind::DEC_JNZ: {
+        const Instruction &dec = run[0];
+        const bool is_wide = dec.dst.is_wide();
+        const u16 value = regfile.read(dec.dst.reg_access);
+
+        regfile.write(dec.dst.reg_access, value - 1);
+        taken = ((value - 1) & alu::width_mask(is_wide)) != 0;
+        defer_flags({value, 1, false, false, is_wide, alu::ARITHMETIC_FLAGS & ~flags::Flag::CF});
+        break;
+    }
+
+    case fusion::Kind::NONE:
+        UNREACHABLE();
+    }
+
+    ip = address;
+    if (taken)
+        ip += jcc.dst.immediate;
+
+    for (const Instruction &inst : run.first(run.size() - 1))
+        cycle_count += timing::estimate(inst, false, 0);
+    cycle_count += timing::estimate(jcc, ip != address, 0);
+    instruction_count += run.size();
+    return true;
+}
+
+void Runner::settle_flags() noexcept {
+    if (!lazy_flags)
+        return;
+
+    const LazyFlags pending = *std::exchange(lazy_flags, std::nullopt);
+    const alu::Result res = pending.is_add
+                                ? alu::add(pending.a, pending.b, pending.carry, pending.is_wide)
+                                : alu::sub(pending.a, pending.b, pending.carry, pending.is_wide);
+    apply_flags(res.flags, pending.affected);
+}
+
+void Runner::defer_flags(const LazyFlags &pending) noexcept {
+    // NOTE(louis): a DEC or INC leaves CF alone, so a CF still owed from before has to land first
+    if (lazy_flags && (lazy_flags->affected & ~pending.affected))
+        settle_flags();
+    lazy_flags = pending;
 }
 
 void Runner::execute_instruction(const instructions::Instruction &inst) noexcept {
+    using instructions::Mnemonic;
+
     switch (inst.mnemonic) {
-    case instructions::Mnemonic::MOV:
+    case Mnemonic::MOV:
         mov(inst);
         break;
 
-    case instructions::Mnemonic::JNE:
+    case Mnemonic::JE:
+    case Mnemonic::JL:
+    case Mnemonic::JLE:
+    case Mnemonic::JB:
+    case Mnemonic::JBE:
+    case Mnemonic::JP:
+    case Mnemonic::JO:
+    case Mnemonic::JS:
+    case Mnemonic::JNE:
+    case Mnemonic::JNL:
+    case Mnemonic::JG:
+    case Mnemonic::JNB:
+    case Mnemonic::JA:
+    case Mnemonic::JNP:
+    case Mnemonic::JNO:
+    case Mnemonic::JNS:
+    case Mnemonic::LOOP:
+    case Mnemonic::LOOPZ:
+    case Mnemonic::LOOPNZ:
+    case Mnemonic::JCXZ:
+    case Mnemonic::JMP:
         jump(inst);
         break;
 
-    case instructions::Mnemonic::ADD:
-    case instructions::Mnemonic::SUB:
-    case instructions::Mnemonic::CMP:
+    case Mnemonic::ADD:
+    case Mnemonic::ADC:
+    case Mnemonic::SUB:
+    case Mnemonic::SBB:
+    case Mnemonic::CMP:
+    case Mnemonic::NEG:
+    case Mnemonic::INC:
+    case Mnemonic::DEC:
         arithmetic(inst);
         break;
 
+    case Mnemonic::AND:
+    case Mnemonic::OR:
+    case Mnemonic::XOR:
+    case Mnemonic::TEST:
+    case Mnemonic::NOT:
+        logical(inst);
+        break;
+
+    case Mnemonic::SHL:
+    case Mnemonic::SHR:
+    case Mnemonic::SAR:
+    case Mnemonic::ROL:
+    case Mnemonic::ROR:
+    case Mnemonic::RCL:
+    case Mnemonic::RCR:
+        shift(inst);
+        break;
+
+    case Mnemonic::MUL:
+    case Mnemonic::IMUL:
+    case Mnemonic::DIV:
+    case Mnemonic::IDIV:
+        multiply(inst);
+        break;
+
+    case Mnemonic::XCHG: {
+        const u16 dst = read_operand(inst.dst);
+        write_operand(inst.dst, read_operand(inst.src));
+        write_operand(inst.src, dst);
+        break;
+    }
+
+    case Mnemonic::LEA:
+        write_operand(inst.dst, effective_address(inst.src.mem_access));
+        break;
+
+    case Mnemonic::CBW:
+        regfile.write({registers::AX, true},
+                      static_cast<u16>(static_cast<s8>(regfile.read({registers::AX, false}))));
+        break;
+
+    case Mnemonic::CWD:
+        regfile.write({registers::DX, true},
+                      (regfile.read({registers::AX, true}) & 0x8000) ? 0xFFFF : 0x0000);
+        break;
+
+    case Mnemonic::NOP:
+        break;
+
+    case Mnemonic::PUSH:
+    case Mnemonic::POP:
+    case Mnemonic::PUSHF:
+    case Mnemonic::POPF:
+        stack(inst);
+        break;
+
+    case Mnemonic::CALL:
+    case Mnemonic::RET:
+        call(inst);
+        break;
+
+    case Mnemonic::INT:
+    case Mnemonic::INT3:
+    case Mnemonic::INTO:
+    case Mnemonic::IRET:
+        interrupt(inst);
+        break;
+
+    case Mnemonic::MOVSB:
+    case Mnemonic::MOVSW:
+    case Mnemonic::CMPSB:
+    case Mnemonic::CMPSW:
+    case Mnemonic::SCASB:
+    case Mnemonic::SCASW:
+    case Mnemonic::LODSB:
+    case Mnemonic::LODSW:
+    case Mnemonic::STOSB:
+    case Mnemonic::STOSW:
+        string_op(inst);
+        break;
+
+    case Mnemonic::CLC:
+        apply_flags(0, flags::Flag::CF);
+        break;
+
+    case Mnemonic::STC:
+        apply_flags(flags::Flag::CF, flags::Flag::CF);
+        break;
+
+    case Mnemonic::CMC:
+        flags.set_flag(flags::Flag::CF, !flags.test_flag(flags::Flag::CF));
+        break;
+
+    case Mnemonic::CLD:
+        flags.set_flag(flags::Flag::DF, false);
+        break;
+
+    case Mnemonic::STD:
+        flags.set_flag(flags::Flag::DF, true);
+        break;
+
+    case Mnemonic::CLI:
+        flags.set_flag(flags::Flag::IF, false);
+        break;
+
+    // NOTE(louis): interrupts stay off for one more instruction, so "sti; hlt" can't lose the
+    // interrupt it's waiting for in between
+    case Mnemonic::STI:
+        flags.set_flag(flags::Flag::IF, true);
+        interrupt_shadow = true;
+        break;
+
+    case Mnemonic::HLT:
+        waiting = true;
+        break;
+
+    case Mnemonic::IN:
+    case Mnemonic::OUT:
+        port_io(inst);
+        break;
+
     default:
         UNREACHABLE();
     }
@@ -70,75 +465,646 @@ void Runner::mov(const instructions::Instruction &inst) noexcept {
 }
 
 void Runner::jump(const instructions::Instruction &inst) noexcept {
+    using flags::Flag;
+    using instructions::Mnemonic;
+
+    const bool cf = flags.test_flag(Flag::CF);
+    const bool pf = flags.test_flag(Flag::PF);
+    const bool zf = flags.test_flag(Flag::ZF);
+    const bool sf = flags.test_flag(Flag::SF);
+    const bool of = flags.test_flag(Flag::OF);
+
+    registers::RegAccess cx{registers::CX, true};
+    bool taken;
+
     switch (inst.mnemonic) {
-    case instructions::Mnemonic::JNE:
-        if (!flags.test_flag(flags::Flag::ZF)) {
-            ip += static_cast<s8>(inst.dst.immediate);
+    // clang-format off
+    case Mnemonic::JE:  taken = zf;                     break;
+    case Mnemonic::JNE: taken = !zf;                    break;
+    case Mnemonic::JL:  taken = sf != of;               break;
+    case Mnemonic::JNL: taken = sf == of;               break;
+    case Mnemonic::JLE: taken = zf || sf != of;         break;
+    case Mnemonic::JG:  taken = !zf && sf == of;        break;
+    case Mnemonic::JB:  taken = cf;                     break;
+    case Mnemonic::JNB: taken = !cf;                    break;
+    case Mnemonic::JBE: taken = cf || zf;               break;
+    case Mnemonic::JA:  taken = !cf && !zf;             break;
+    case Mnemonic::JP:  taken = pf;                     break;
+    case Mnemonic::JNP: taken = !pf;                    break;
+    case Mnemonic::JO:  taken = of;                     break;
+    case Mnemonic::JNO: taken = !of;                    break;
+    case Mnemonic::JS:  taken = sf;                     break;
+    case Mnemonic::JNS: taken = !sf;                    break;
+    case Mnemonic::JCXZ: taken = regfile.read(cx) == 0; break;
+    // clang-format on
+
+    case Mnemonic::LOOP:
+    case Mnemonic::LOOPZ:
+    case Mnemonic::LOOPNZ: {
+        const u16 count = regfile.read(cx) - 1;
+        regfile.write(cx, count);
+
+        taken = count != 0 && (inst.mnemonic == Mnemonic::LOOP ||
+                               (inst.mnemonic == Mnemonic::LOOPZ ? zf : !zf));
+        break;
+    }
+
+    case Mnemonic::JMP:
+        if (inst.dst.type != instructions::Operand::Type::RELATIVE) {
+            ip = read_operand(inst.dst);
+            return;
         }
 
+        taken = true;
         break;
+
     default:
         UNREACHABLE();
     }
+
+    if (taken) {
+        ip += inst.dst.immediate;
+    }
 }
 
 void Runner::arithmetic(const instructions::Instruction &inst) noexcept {
-    u16 dst = read_operand(inst.dst);
-    u16 src = read_operand(inst.src);
-    u16 res;
+    using instructions::Mnemonic;
+
+    const bool is_wide = inst.dst.is_wide();
+    const u16 dst = read_operand(inst.dst);
+
+    LazyFlags op{dst, 0, false, false, is_wide, alu::ARITHMETIC_FLAGS};
+    switch (inst.mnemonic) {
+    case Mnemonic::ADD:
+    case Mnemonic::ADC:
+        op.b = read_operand(inst.src);
+        op.carry = inst.mnemonic == Mnemonic::ADC && flags.test_flag(flags::Flag::CF);
+        op.is_add = true;
+        break;
+
+    case Mnemonic::SUB:
+    case Mnemonic::CMP:
+    case Mnemonic::SBB:
+        op.b = read_operand(inst.src);
+        op.carry = inst.mnemonic == Mnemonic::SBB && flags.test_flag(flags::Flag::CF);
+        break;
+
+    case Mnemonic::NEG:
+        op.a = 0;
+        op.b = dst;
+        break;
+
+    // INC/DEC leave CF alone
+    case Mnemonic::INC:
+    case Mnemonic::DEC:
+        op.b = 1;
+        op.is_add = inst.mnemonic == Mnemonic::INC;
+        op.affected &= ~flags::Flag::CF;
+        break;
+
+    default:
+        UNREACHABLE();
+    }
+
+    // NOTE(louis): flags nothing reads are only owed, not dropped, so a stop or an interrupt
+    // still sees exactly what stepping would have left
+    if (deferring && graph && graph->dead_flags(inst.address) == op.affected) {
+        if (inst.mnemonic != Mnemonic::CMP) {
+            const u16 value = op.is_add ? op.a + op.b + op.carry : op.a - op.b - op.carry;
+            write_operand(inst.dst, value & alu::width_mask(is_wide));
+        }
+        defer_flags(op);
+        return;
+    }
+
+    const alu::Result res = op.is_add ? alu::add(op.a, op.b, op.carry, is_wide)
+                                      : alu::sub(op.a, op.b, op.carry, is_wide);
+    if (inst.mnemonic != Mnemonic::CMP) {
+        write_operand(inst.dst, res.value);
+    }
+
+    apply_flags(res.flags, op.affected);
+}
+
+void Runner::logical(const instructions::Instruction &inst) noexcept {
+    using instructions::Mnemonic;
+
+    const bool is_wide = inst.dst.is_wide();
+    const u16 dst = read_operand(inst.dst);
+
+    // NOT is the only one of these that doesn't touch the flags
+    if (inst.mnemonic == Mnemonic::NOT) {
+        write_operand(inst.dst, ~dst & alu::width_mask(is_wide));
+        return;
+    }
+
+    const u16 src = read_operand(inst.src);
+
+    alu::Result res;
+    switch (inst.mnemonic) {
+    case Mnemonic::AND:
+    case Mnemonic::TEST:
+        res = alu::logic(dst & src, is_wide);
+        break;
+
+    case Mnemonic::OR:
+        res = alu::logic(dst | src, is_wide);
+        break;
+
+    case Mnemonic::XOR:
+        res = alu::logic(dst ^ src, is_wide);
+        break;
+
+    default:
+        UNREACHABLE();
+    }
+
+    if (inst.mnemonic != Mnemonic::TEST) {
+        write_operand(inst.dst, res.value);
+    }
+
+    apply_flags(res.flags, res.affected);
+}
+
+void Runner::shift(const instructions::Instruction &inst) noexcept {
+    using instructions::Mnemonic;
+
+    const bool is_wide = inst.dst.is_wide();
+    const bool cf = flags.test_flag(flags::Flag::CF);
+    const u16 dst = read_operand(inst.dst);
+    const u8 count = read_operand(inst.src) & 0xFF;
+
+    // a zero count is a no-op, flags included
+    if (count == 0)
+        return;
+
+    alu::Result res;
+    switch (inst.mnemonic) {
+    // clang-format off
+    case Mnemonic::SHL: res = alu::shl(dst, count, is_wide);     break;
+    case Mnemonic::SHR: res = alu::shr(dst, count, is_wide);     break;
+    case Mnemonic::SAR: res = alu::sar(dst, count, is_wide);     break;
+    case Mnemonic::ROL: res = alu::rol(dst, count, is_wide);     break;
+    case Mnemonic::ROR: res = alu::ror(dst, count, is_wide);     break;
+    case Mnemonic::RCL: res = alu::rcl(dst, count, cf, is_wide); break;
+    case Mnemonic::RCR: res = alu::rcr(dst, count, cf, is_wide); break;
+    // clang-format on
+    default:
+        UNREACHABLE();
+    }
+
+    write_operand(inst.dst, res.value);
+    apply_flags(res.flags, res.affected);
+}
+
+void Runner::multiply(const instructions::Instruction &inst) noexcept {
+    using instructions::Mnemonic;
+
+    // the implicit operand is AL/AX, widening into AX or DX:AX
+    const bool is_wide = inst.dst.is_wide();
+    const u16 src = read_operand(inst.dst);
+
+    registers::RegAccess ax{registers::AX, true};
+    registers::RegAccess dx{registers::DX, true};
+    registers::RegAccess al{registers::AX, false};
+    registers::RegAccess ah{registers::AX | 0b100, false};
 
     switch (inst.mnemonic) {
-    case instructions::Mnemonic::ADD:
-        res = dst + src;
-        write_operand(inst.dst, res);
+    case Mnemonic::MUL:
+    case Mnemonic::IMUL: {
+        const u16 acc = regfile.read(is_wide ? ax : al);
+        const alu::WideResult res = inst.mnemonic == Mnemonic::MUL
+                                        ? alu::mul(acc, src, is_wide)
+                                        : alu::imul(acc, src, is_wide);
+
+        if (is_wide) {
+            regfile.write(ax, res.low);
+            regfile.write(dx, res.high);
+        } else {
+            regfile.write(ax, (res.high << 8) | res.low);
+        }
+
+        apply_flags(res.flags, res.affected);
+        break;
+    }
+
+    case Mnemonic::DIV:
+    case Mnemonic::IDIV: {
+        const std::uint32_t dividend = is_wide ? (std::uint32_t{regfile.read(dx)} << 16) |
+                                                     regfile.read(ax)
+                                               : regfile.read(ax);
+        const alu::DivResult res = inst.mnemonic == Mnemonic::DIV
+                                       ? alu::div(dividend, src, is_wide)
+                                       : alu::idiv(dividend, src, is_wide);
+
+        if (res.overflow) {
+            interrupt(0);
+            break;
+        }
+
+        if (is_wide) {
+            regfile.write(ax, res.quotient);
+            regfile.write(dx, res.remainder);
+        } else {
+            regfile.write(al, res.quotient);
+            regfile.write(ah, res.remainder);
+        }
+        break;
+    }
+
+    default:
+        UNREACHABLE();
+    }
+}
+
+void Runner::compare(u16 dst, u16 src, bool is_wide) noexcept {
+    const alu::Result res = alu::sub(dst, src, false, is_wide);
+    apply_flags(res.flags, res.affected);
+}
+
+void Runner::apply_flags(u16 values, u16 affected) noexcept {
+    if (lazy_flags && !(lazy_flags->affected &= ~affected))
+        lazy_flags.reset();
+    flags.set_word((flags.word() & ~affected) | (values & affected));
+}
+
+void Runner::stack(const instructions::Instruction &inst) noexcept {
+    switch (inst.mnemonic) {
+    case instructions::Mnemonic::PUSH: {
+        u16 value = read_operand(inst.dst);
+
+        // NOTE(louis): the 8086 pushes the already-decremented value of sp
+        if (inst.dst.type == instructions::Operand::Type::REGISTER &&
+            inst.dst.reg_access.index == registers::SP) {
+            value -= 2;
+        }
+
+        push(value);
+        break;
+    }
+
+    case instructions::Mnemonic::POP: {
+        if (inst.dst.type == instructions::Operand::Type::SEGMENT &&
+            inst.dst.reg_access.index == registers::CS &&
+            !keeps_code_segment(peek_word(regfile.segment_base(registers::SS),
+                                          regfile.read({registers::SP, true}))))
+            break;
+
+        u16 value = pop();
+        write_operand(inst.dst, value);
+        break;
+    }
+
+    case instructions::Mnemonic::PUSHF:
+        push(flags.word());
+        break;
+
+    case instructions::Mnemonic::POPF:
+        apply_flags(pop(), 0xFFFF);
+        break;
+
+    default:
+        UNREACHABLE();
+    }
+}
+
+void Runner::call(const instructions::Instruction &inst) noexcept {
+    switch (inst.mnemonic) {
+    case instructions::Mnemonic::CALL: {
+        u16 target = inst.dst.type == instructions::Operand::Type::RELATIVE
+                         ? static_cast<u16>(ip + inst.dst.immediate)
+                         : read_operand(inst.dst);
+
+        push(ip);
+        call_stack.call(target, ip);
+        ip = target;
+        break;
+    }
+
+    case instructions::Mnemonic::RET: {
+        ip = pop();
+
+        if (inst.dst.type == instructions::Operand::Type::IMMEDIATE) {
+            registers::RegAccess sp{registers::SP, true};
+            regfile.write(sp, regfile.read(sp) + inst.dst.immediate);
+        }
+
+        call_stack.ret(ip);
+        break;
+    }
+
+    default:
+        UNREACHABLE();
+    }
+}
+
+void Runner::interrupt(const instructions::Instruction &inst) noexcept {
+    switch (inst.mnemonic) {
+    case instructions::Mnemonic::INT:
+        interrupt(static_cast<u8>(inst.dst.immediate));
+        break;
+
+    case instructions::Mnemonic::INT3:
+        interrupt(3);
+        break;
+
+    case instructions::Mnemonic::INTO:
+        if (flags.test_flag(flags::Flag::OF)) {
+            interrupt(4);
+        }
+
+        break;
+
+    case instructions::Mnemonic::IRET:
+        if (!keeps_code_segment(peek_word(regfile.segment_base(registers::SS),
+                                          regfile.read({registers::SP, true}) + 2)))
+            break;
+
+        ip = pop();
+        regfile.write_segment(registers::CS, pop());
+        apply_flags(pop(), 0xFFFF);
+
+        call_stack.ret(ip);
+        break;
+
+    default:
+        UNREACHABLE();
+    }
+}
+
+void Runner::string_op(const instructions::Instruction &inst) noexcept {
+    using instructions::Mnemonic;
+
+    const bool is_wide = inst.mnemonic == Mnemonic::MOVSW || inst.mnemonic == Mnemonic::CMPSW ||
+                         inst.mnemonic == Mnemonic::SCASW || inst.mnemonic == Mnemonic::LODSW ||
+                         inst.mnemonic == Mnemonic::STOSW;
+
+    // only the ds:si side can be overridden, es:di is fixed
+    const std::uint32_t source = regfile.segment_base(inst.segment.value_or(registers::DS));
+
+    if (inst.prefix == instructions::Prefix::NONE) {
+        string_element(inst.mnemonic, is_wide, source);
+        return;
+    }
+
+    if (string_bulk(inst, is_wide, source))
+        return;
+
+    const bool tests_zf = inst.mnemonic == Mnemonic::CMPSB || inst.mnemonic == Mnemonic::CMPSW ||
+                          inst.mnemonic == Mnemonic::SCASB || inst.mnemonic == Mnemonic::SCASW;
+
+    registers::RegAccess cx{registers::CX, true};
+    while (regfile.read(cx) != 0) {
+        string_element(inst.mnemonic, is_wide, source);
+        regfile.write(cx, regfile.read(cx) - 1);
+
+        if (tests_zf) {
+            const bool zf = flags.test_flag(flags::Flag::ZF);
+            if ((inst.prefix == instructions::Prefix::REP && !zf) ||
+                (inst.prefix == instructions::Prefix::REPNE && zf))
+                break;
+        }
+    }
+}
+
+void Runner::string_element(instructions::Mnemonic mnemonic, bool is_wide,
+                            std::uint32_t source) noexcept {
+    using instructions::Mnemonic;
+
+    registers::RegAccess si_access{registers::SI, true};
+    registers::RegAccess di_access{registers::DI, true};
+    registers::RegAccess acc{registers::AX, is_wide};
+
+    const u16 size = is_wide ? 2 : 1;
+    const u16 delta = flags.test_flag(flags::Flag::DF) ? -size : size;
+    const u16 si = regfile.read(si_access);
+    const u16 di = regfile.read(di_access);
+    const std::uint32_t extra = regfile.segment_base(registers::ES);
+
+    auto load = [&](std::uint32_t base, u16 offset) -> u16 {
+        if (is_wide)
+            return load_word(base, offset);
+        touch(base + offset);
+        return pages.read(base + offset);
+    };
+
+    auto store = [&](u16 offset, u16 value) {
+        if (is_wide) {
+            store_word(extra, offset, value);
+        } else {
+            touch(extra + offset);
+            pages.write(extra + offset, value & 0xFF);
+        }
+    };
+
+    switch (mnemonic) {
+    case Mnemonic::MOVSB:
+    case Mnemonic::MOVSW:
+        store(di, load(source, si));
+        regfile.write(si_access, si + delta);
+        regfile.write(di_access, di + delta);
         break;
 
-    case instructions::Mnemonic::SUB:
-        res = dst - src;
-        write_operand(inst.dst, res);
+    case Mnemonic::CMPSB:
+    case Mnemonic::CMPSW:
+        compare(load(source, si), load(extra, di), is_wide);
+        regfile.write(si_access, si + delta);
+        regfile.write(di_access, di + delta);
         break;
 
-    case instructions::Mnemonic::CMP:
-        res = dst - src;
+    case Mnemonic::SCASB:
+    case Mnemonic::SCASW:
+        compare(regfile.read(acc), load(extra, di), is_wide);
+        regfile.write(di_access, di + delta);
+        break;
+
+    case Mnemonic::LODSB:
+    case Mnemonic::LODSW:
+        regfile.write(acc, load(source, si));
+        regfile.write(si_access, si + delta);
+        break;
+
+    case Mnemonic::STOSB:
+    case Mnemonic::STOSW:
+        store(di, regfile.read(acc));
+        regfile.write(di_access, di + delta);
         break;
 
     default:
         UNREACHABLE();
     }
+}
+
+bool Runner::string_bulk(const instructions::Instruction &inst, bool is_wide,
+                         std::uint32_t source) noexcept {
+    using instructions::Mnemonic;
+
+    // NOTE(louis): only forward, non-wrapping runs map onto the host routines; anything else
+    // (std, si/di wrapping past 0xFFFF, overlapping moves) goes element by element instead
+    if (flags.test_flag(flags::Flag::DF) || statistics)
+        return false;
+
+    registers::RegAccess cx_access{registers::CX, true};
+    registers::RegAccess si_access{registers::SI, true};
+    registers::RegAccess di_access{registers::DI, true};
+
+    const u16 count = regfile.read(cx_access);
+    const u16 si = regfile.read(si_access);
+    const u16 di = regfile.read(di_access);
+    const std::size_t n = static_cast<std::size_t>(count) * (is_wide ? 2 : 1);
+
+    // linear addresses, which only stay contiguous while the offsets don't wrap
+    const std::uint32_t from = source + si;
+    const std::uint32_t to = regfile.segment_base(registers::ES) + di;
+    const bool si_fits = si + n <= 0x10000 && pages.is_ram(from, n);
+    const bool di_fits = di + n <= 0x10000 && pages.is_ram(to, n);
+    u8 *ram = guest.bytes().data();
+
+    switch (inst.mnemonic) {
+    case Mnemonic::MOVSB:
+    case Mnemonic::MOVSW:
+        // a forward copy into [si + 1, si + n) replicates the source, which memmove wouldn't
+        if (!si_fits || !di_fits || (from < to && to < from + n))
+            return false;
 
-    if (!inst.dst.reg_access.is_wide) {
-        res &= 0xFF;
+        std::memmove(&ram[to], &ram[from], n);
+        regfile.write(si_access, si + n);
+        break;
+
+    case Mnemonic::STOSB:
+    case Mnemonic::STOSW: {
+        if (!di_fits)
+            return false;
+
+        const u16 value = regfile.read({registers::AX, is_wide});
+        const u8 low = value & 0xFF;
+        const u8 high = value >> 8;
+
+        if (!is_wide || low == high) {
+            std::memset(&ram[to], low, n);
+        } else if (n != 0) {
+            // seed one word, then keep doubling the filled prefix
+            store_word(regfile.segment_base(registers::ES), di, value);
+            for (std::size_t filled = 2; filled < n; filled *= 2)
+                std::memcpy(&ram[to + filled], &ram[to], std::min(filled, n - filled));
+        }
+        break;
     }
 
-    flags.set_flag(flags::Flag::ZF, res == 0);
-    flags.set_flag(flags::Flag::SF, res & (inst.dst.reg_access.is_wide ? 0x8000 : 0x80));
+    case Mnemonic::SCASB: {
+        if (inst.prefix != instructions::Prefix::REPNE || !di_fits || n == 0)
+            return false;
+
+        const u8 al = regfile.read({registers::AX, false});
+        const u8 *start = &ram[to];
+        const u8 *found = static_cast<const u8 *>(std::memchr(start, al, n));
+
+        // same flags and register state as stepping through the scan until the match (or end)
+        const std::size_t scanned = found ? found - start + 1 : n;
+        compare(al, start[scanned - 1], false);
+
+        regfile.write(di_access, di + scanned);
+        regfile.write(cx_access, count - scanned);
+        return true;
+    }
+
+    default:
+        return false;
+    }
+
+    regfile.write(di_access, di + n);
+    regfile.write(cx_access, 0);
+    return true;
+}
+
+void Runner::port_io(const instructions::Instruction &inst) noexcept {
+    const io::Time now{instruction_count, cycle_count};
+
+    if (inst.mnemonic == instructions::Mnemonic::IN) {
+        const bool is_wide = inst.dst.is_wide();
+        const u16 port = read_operand(inst.src);
+        write_operand(inst.dst, device ? device->in(port, is_wide, now) : is_wide ? 0xFFFF : 0xFF);
+    } else if (device) {
+        device->out(read_operand(inst.dst), read_operand(inst.src), inst.src.is_wide(), now);
+    }
+}
+
+void Runner::interrupt(u8 vector) noexcept {
+    if (!keeps_code_segment(load_word(0, vector * 4 + 2)))
+        return;
+
+    push(flags.word());
+    flags.set_flag(flags::Flag::IF, false);
+    flags.set_flag(flags::Flag::TF, false);
+
+    push(regfile.read_segment(registers::CS));
+    push(ip);
+
+    const u16 handler = load_word(0, vector * 4);
+    call_stack.call(handler, ip);
+    ip = handler;
+}
+
+void Runner::push(u16 value) noexcept {
+    registers::RegAccess sp_access{registers::SP, true};
+    const u16 sp = regfile.read(sp_access) - 2;
+
+    regfile.write(sp_access, sp);
+    store_word(regfile.segment_base(registers::SS), sp, value);
+}
+
+u16 Runner::pop() noexcept {
+    registers::RegAccess sp_access{registers::SP, true};
+    const u16 sp = regfile.read(sp_access);
+
+    regfile.write(sp_access, sp + 2);
+    return load_word(regfile.segment_base(registers::SS), sp);
+}
+
+u16 Runner::load_word(std::uint32_t base, u16 offset) noexcept {
+    touch(base + offset);
+    return peek_word(base, offset);
 }
 
-u16 Runner::read_operand(const instructions::Operand &operand) const noexcept {
+u16 Runner::peek_word(std::uint32_t base, u16 offset) noexcept {
+    u8 low = pages.read(base + offset);
+    u8 high = pages.read(base + static_cast<u16>(offset + 1));
+
+    return (high << 8) | low;
+}
+
+void Runner::store_word(std::uint32_t base, u16 offset, u16 value) noexcept {
+    touch(base + offset);
+    pages.write(base + offset, value & 0xFF);
+    pages.write(base + static_cast<u16>(offset + 1), value >> 8);
+}
+
+u16 Runner::effective_address(const mem::MemoryAccess &access) const noexcept {
+    return access.displacement + regfile.read_term(access.terms[0].index) +
+           regfile.read_term(access.terms[1].index);
+}
+
+u16 Runner::read_operand(const instructions::Operand &operand) noexcept {
+    perf::Scope scope(instrumentation, perf::OPERANDS);
+
     switch (operand.type) {
     case instructions::Operand::Type::REGISTER:
         return regfile.read(operand.reg_access);
 
+    case instructions::Operand::Type::SEGMENT:
+        return regfile.read_segment(operand.reg_access.index);
+
     case instructions::Operand::Type::IMMEDIATE:
         return operand.immediate;
 
     case instructions::Operand::Type::MEMORY: {
-        u16 offset = operand.mem_access.displacement;
-
-        if (operand.mem_access.terms[0].index != registers::NONE)
-            offset += regfile.read(operand.mem_access.terms[0]);
-
-        if (operand.mem_access.terms[1].index != registers::NONE)
-            offset += regfile.read(operand.mem_access.terms[1]);
+        const std::uint32_t base = regfile.segment_base(operand.mem_access.segment);
+        const u16 offset = effective_address(operand.mem_access);
 
-        if (operand.mem_access.is_wide) {
-            u8 low = data_memory[offset];
-            u8 high = data_memory[offset + 1];
-
-            return (high << 8) | low;
-        } else {
-            return data_memory[offset];
-        }
+        if (operand.mem_access.is_wide)
+            return load_word(base, offset);
+        touch(base + offset);
+        return pages.read(base + offset);
     }
 
     default:
@@ -147,24 +1113,28 @@ u16 Runner::read_operand(const instructions::Operand &operand) const noexcept {
 }
 
 void Runner::write_operand(const instructions::Operand &operand, u16 value) noexcept {
+    perf::Scope scope(instrumentation, perf::OPERANDS);
+
     switch (operand.type) {
     case instructions::Operand::Type::REGISTER:
         return regfile.write(operand.reg_access, value);
 
-    case instructions::Operand::Type::MEMORY: {
-        u16 offset = operand.mem_access.displacement;
-
-        if (operand.mem_access.terms[0].index != registers::NONE)
-            offset += regfile.read(operand.mem_access.terms[0]);
+    case instructions::Operand::Type::SEGMENT:
+        if (operand.reg_access.index == registers::CS && !keeps_code_segment(value))
+            break;
+        regfile.write_segment(operand.reg_access.index, value);
+        interrupt_shadow = operand.reg_access.index == registers::SS;
+        break;
 
-        if (operand.mem_access.terms[1].index != registers::NONE)
-            offset += regfile.read(operand.mem_access.terms[1]);
+    case instructions::Operand::Type::MEMORY: {
+        const std::uint32_t base = regfile.segment_base(operand.mem_access.segment);
+        const u16 offset = effective_address(operand.mem_access);
 
         if (operand.mem_access.is_wide) {
-            data_memory[offset] = value & 0xFF;
-            data_memory[offset + 1] = (value >> 8);
+            store_word(base, offset, value);
         } else {
-            data_memory[offset] = value & 0xFF;
+            touch(base + offset);
+            pages.write(base + offset, value & 0xFF);
         }
 
         break;
@@ -1,37 +1,220 @@
 #pragma once
 
 #include "common.hpp"
+
+#include "bus.hpp"
+#include "cfg.hpp"
 #include "flags.hpp"
+#include "fusion.hpp"
+#include "image.hpp"
 #include "instructions.hpp"
+#include "io.hpp"
+#include "perf.hpp"
+#include "profile.hpp"
 #include "registers.hpp"
+#include "stats.hpp"
 
-#include <vector>
+#include <cstdint>
+#include <optional>
+#include <span>
+#include <unordered_map>
+#include <utility>
 
 namespace sim::runner {
 
+enum class StopReason : u8 {
+    HALTED,       // ip ran off the end of the image, or a hlt has nothing left to wake it
+    DECODE_ERROR, // ip points at something that doesn't decode
+    IP,
+    CYCLES,
+    INSTRUCTIONS,
+    CODE_SEGMENT, // something tried to load cs with anything but 0
+};
+
+// Any combination of conditions; run_until stops at whichever is hit first. Cycle and
+// instruction limits are totals since the runner was created, not deltas.
+struct Limits {
+    std::optional<u16> ip;
+    std::optional<std::uint64_t> cycles;
+    std::optional<std::uint64_t> instructions;
+};
+
+struct RunResult {
+    StopReason reason;
+    u16 ip;
+    std::uint64_t instructions;
+    std::uint64_t cycles;
+};
+
 class Runner {
 public:
-    Runner(const std::vector<u8> instruction_memory)
-        : instruction_memory(instruction_memory), regfile() {}
+    // NOTE(louis): code and data share the one address space, ip starts at the image's first byte
+    explicit Runner(image::GuestMemory guest)
+        : guest(std::move(guest)),
+          memory(this->guest.bytes().first(image::GuestMemory::SEGMENT_SIZE)),
+          pages(this->guest.bytes()), regfile() {}
+
+    // Decodes and executes the instruction at ip. Returns nullopt, leaving ip in place, if it
+    // doesn't decode or would move code out of segment 0 (see left_code_segment). A hlt sleeps
+    // through to the interrupt that wakes it within the same step.
+    std::optional<instructions::Instruction> step() noexcept;
+    [[nodiscard]] RunResult run_until(const Limits &limits) noexcept;
+    [[nodiscard]] bool halted() const noexcept { return asleep || ip >= guest.image().size(); }
+    // Whether the last step or run stopped on an instruction or interrupt that would have loaded
+    // cs with anything but 0. Nothing it would have done has happened.
+    [[nodiscard]] bool left_code_segment() const noexcept { return left_segment; }
+
+    [[nodiscard]] registers::RegFile &get_registers() noexcept { return regfile; }
+    [[nodiscard]] const registers::RegFile &get_registers() const noexcept { return regfile; }
+    [[nodiscard]] flags::FlagState &get_flags() noexcept { return flags; }
+    [[nodiscard]] const flags::FlagState &get_flags() const noexcept { return flags; }
+    [[nodiscard]] std::span<u8> get_memory() noexcept { return guest.bytes(); }
+    [[nodiscard]] std::span<const u8> get_memory() const noexcept { return guest.bytes(); }
+    [[nodiscard]] std::span<const u8> get_image() const noexcept { return guest.image(); }
+
+    [[nodiscard]] u16 get_ip() const noexcept { return ip; }
+    void set_ip(u16 value) noexcept { ip = value; }
+
+    [[nodiscard]] std::uint64_t get_instructions() const noexcept { return instruction_count; }
+    [[nodiscard]] std::uint64_t get_cycles() const noexcept { return cycle_count; }
+
+    void attach_profiler(profile::Profiler &p) noexcept {
+        profiler = &p;
+        call_stack.attach(&p);
+    }
+
+    [[nodiscard]] const profile::CallStack &get_call_stack() const noexcept { return call_stack; }
+
+    void attach_instrumentation(perf::Instrumentation &i) noexcept { instrumentation = &i; }
+
+    // Counts every instruction and data access; like a profiler, this turns fusion off
+    void attach_stats(stats::Stats &s) noexcept { statistics = &s; }
+
+    // Builds the control flow graph from ip over the image, after which run_until leaves the
+    // flags of an add or subtract unwritten wherever the graph says nothing reads them
+    void analyse() noexcept { graph = cfg::Graph::build(memory, guest.image().size(), ip); }
 
-    void run() noexcept;
+    // Without a device, IN reads all ones and OUT goes nowhere
+    void attach_device(io::Device &d) noexcept { device = &d; }
+
+    // Routes data accesses to [base, base + size) to the device instead of RAM. Instruction
+    // fetch still reads RAM. Fails unless both are page aligned.
+    bool map_memory(std::uint32_t base, std::uint32_t size, bus::MemoryDevice &d) noexcept {
+        return pages.map(base, size, d);
+    }
 
 private:
-    // TODO(louis): combine - good use for memory abstraction
-    const std::vector<u8> instruction_memory;
-    std::array<u8, 1 << 16> data_memory;
+    image::GuestMemory guest;
+    // NOTE(louis): code is fetched from here, the first 64K, which is why cs has to stay 0
+    std::span<u8> memory;
+    bus::PageTable pages;
 
     registers::RegFile regfile;
     flags::FlagState flags;
     u16 ip = 0;
+    bool interrupt_shadow = false;
+    bool waiting = false; // after a hlt, until an interrupt is delivered
+    bool asleep = false;  // waiting, and nothing will ever deliver one
+    bool left_segment = false;
+
+    std::uint64_t instruction_count = 0;
+    std::uint64_t cycle_count = 0;
+
+    profile::CallStack call_stack;
+    profile::Profiler *profiler = nullptr;
+    perf::Instrumentation *instrumentation = nullptr;
+    stats::Stats *statistics = nullptr;
+    io::Device *device = nullptr;
+
+    // The operands of the last add or subtract whose flags haven't been written yet. Anything
+    // that reads flags settles them first, and anything that writes them drops them from affected.
+    struct LazyFlags {
+        u16 a;
+        u16 b;
+        bool carry;
+        bool is_add;
+        bool is_wide;
+        u16 affected;
+    };
+    std::optional<LazyFlags> lazy_flags;
+
+    std::optional<cfg::Graph> graph;
+    bool deferring = false; // inside run_until, which settles before it returns
+
+    // Superinstructions by the address of their first instruction, or Kind::NONE where decoding
+    // ahead found nothing to fuse. Each is checked against memory before it's used, so code that
+    // rewrites itself just falls back to decoding.
+    std::unordered_map<u16, fusion::Superinstruction> superinstructions;
+
+    void poll_interrupts() noexcept;
+    // While waiting, skips ahead from one point an interrupt could arrive to the next, stopping
+    // when one does or the cycle count reaches until. The instruction count stands still.
+    void sleep(std::uint64_t until) noexcept;
+    [[nodiscard]] std::optional<instructions::Instruction> fetch() const noexcept;
+    void retire(const instructions::Instruction &inst) noexcept;
+
+    // The entry at ip, if ip's been tried and memory still holds what was decoded there
+    [[nodiscard]] const fusion::Superinstruction *cached_fusion() noexcept;
+    // Decodes ahead of first, the instruction at ip, and caches what it finds, a run of
+    // Kind::NONE included
+    [[nodiscard]] const fusion::Superinstruction *
+    fuse(const instructions::Instruction &first) noexcept;
+    // Executes fused as one step, unless the limits would have stopped partway through it
+    [[nodiscard]] bool run_fused(const fusion::Superinstruction &fused,
+                                 const Limits &limits) noexcept;
+    void settle_flags() noexcept;
+    void defer_flags(const LazyFlags &pending) noexcept;
 
     void execute_instruction(const instructions::Instruction &inst) noexcept;
 
     void mov(const instructions::Instruction &inst) noexcept;
     void jump(const instructions::Instruction &inst) noexcept;
     void arithmetic(const instructions::Instruction &inst) noexcept;
+    void logical(const instructions::Instruction &inst) noexcept;
+    void shift(const instructions::Instruction &inst) noexcept;
+    void multiply(const instructions::Instruction &inst) noexcept;
+    void stack(const instructions::Instruction &inst) noexcept;
+    void call(const instructions::Instruction &inst) noexcept;
+    void interrupt(const instructions::Instruction &inst) noexcept;
+    void string_op(const instructions::Instruction &inst) noexcept;
+    void port_io(const instructions::Instruction &inst) noexcept;
+
+    void interrupt(u8 vector) noexcept;
+
+    // false, and the run stops, when segment is anything but 0; checked before whatever would
+    // load it into cs has any effect
+    [[nodiscard]] bool keeps_code_segment(u16 segment) noexcept {
+        left_segment = segment != 0;
+        return !left_segment;
+    }
+
+    // source is the segment base for si, ds unless overridden
+    void string_element(instructions::Mnemonic mnemonic, bool is_wide,
+                        std::uint32_t source) noexcept;
+    [[nodiscard]] bool string_bulk(const instructions::Instruction &inst, bool is_wide,
+                                   std::uint32_t source) noexcept;
+
+    void compare(u16 dst, u16 src, bool is_wide) noexcept;
+    void apply_flags(u16 values, u16 affected) noexcept;
+
+    // NOTE(louis): SS:SP accesses skip effective address resolution entirely
+    void push(u16 value) noexcept;
+    [[nodiscard]] u16 pop() noexcept;
+
+    // A data access at a linear address, for statistics
+    void touch(std::uint32_t address) noexcept {
+        if (statistics)
+            statistics->access(address);
+    }
+
+    // base is a segment base; the second byte wraps within the segment like the first
+    [[nodiscard]] u16 load_word(std::uint32_t base, u16 offset) noexcept;
+    // the same without counting as an access, for looking before popping
+    [[nodiscard]] u16 peek_word(std::uint32_t base, u16 offset) noexcept;
+    void store_word(std::uint32_t base, u16 offset, u16 value) noexcept;
 
-    [[nodiscard]] u16 read_operand(const instructions::Operand &operand) const noexcept;
+    [[nodiscard]] u16 effective_address(const mem::MemoryAccess &access) const noexcept;
+    [[nodiscard]] u16 read_operand(const instructions::Operand &operand) noexcept;
     void write_operand(const instructions::Operand &operand, u16 value) noexcept;
 };
 
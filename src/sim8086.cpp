@@ -0,0 +1,126 @@
+#include "common.hpp"
+
+#include "image.hpp"
+#include "instructions.hpp"
+#include "runner.hpp"
+#include "sim8086.h"
+
+#include <new>
+#include <utility>
+
+struct sim8086 {
+    sim::runner::Runner runner;
+};
+
+namespace {
+sim::registers::RegAccess wide(sim8086_register reg) noexcept {
+    return {static_cast<u8>(reg & 0b111), true};
+}
+
+bool is_segment(sim8086_register reg) noexcept { return reg >= SIM8086_ES; }
+u8 segment(sim8086_register reg) noexcept { return static_cast<u8>((reg - SIM8086_ES) & 0b11); }
+} // namespace
+
+extern "C" {
+
+sim8086 *sim8086_create(const uint8_t *image, size_t size) {
+    auto memory = sim::image::GuestMemory::copy_of({image, size});
+    if (!memory)
+        return nullptr;
+
+    return new (std::nothrow) sim8086{sim::runner::Runner(std::move(*memory))};
+}
+
+sim8086 *sim8086_create_from_file(const char *path) {
+    auto memory = sim::image::GuestMemory::map_file(path);
+    if (!memory)
+        return nullptr;
+
+    return new (std::nothrow) sim8086{sim::runner::Runner(std::move(*memory))};
+}
+
+sim8086 *sim8086_create_in_place(uint8_t *memory, size_t memory_size, size_t image_size) {
+    if (memory_size < sim::image::GuestMemory::SEGMENT_SIZE || image_size > memory_size)
+        return nullptr;
+
+    return new (std::nothrow) sim8086{
+        sim::runner::Runner(sim::image::GuestMemory::borrow({memory, memory_size}, image_size))};
+}
+
+void sim8086_destroy(sim8086 *sim) { delete sim; }
+
+int sim8086_step(sim8086 *sim, sim8086_instruction *out) {
+    if (sim->runner.halted())
+        return 1;
+
+    const auto inst = sim->runner.step();
+    if (!inst)
+        return sim->runner.left_code_segment() ? -2 : -1;
+
+    if (out) {
+        *out = sim8086_instruction{
+            .address = static_cast<uint16_t>(inst->address),
+            .size = static_cast<uint8_t>(inst->bytes.size()),
+            .mnemonic = static_cast<uint8_t>(inst->mnemonic),
+        };
+    }
+    return 0;
+}
+
+sim8086_run_result sim8086_run_until(sim8086 *sim, const sim8086_limits *limits) {
+    sim::runner::Limits until;
+    if (limits && (limits->mask & SIM8086_UNTIL_IP))
+        until.ip = limits->ip;
+    if (limits && (limits->mask & SIM8086_UNTIL_CYCLES))
+        until.cycles = limits->cycles;
+    if (limits && (limits->mask & SIM8086_UNTIL_INSTRUCTIONS))
+        until.instructions = limits->instructions;
+
+    const auto result = sim->runner.run_until(until);
+    return sim8086_run_result{
+        .reason = static_cast<sim8086_stop_reason>(result.reason),
+        .ip = result.ip,
+        .instructions = result.instructions,
+        .cycles = result.cycles,
+    };
+}
+
+void sim8086_analyse(sim8086 *sim) { sim->runner.analyse(); }
+
+uint16_t sim8086_get_register(const sim8086 *sim, sim8086_register reg) {
+    const auto &regfile = sim->runner.get_registers();
+    return is_segment(reg) ? regfile.read_segment(segment(reg)) : regfile.read(wide(reg));
+}
+
+int sim8086_set_register(sim8086 *sim, sim8086_register reg, uint16_t value) {
+    if (reg == SIM8086_CS && value != 0)
+        return -2;
+
+    auto &regfile = sim->runner.get_registers();
+    if (is_segment(reg))
+        regfile.write_segment(segment(reg), value);
+    else
+        regfile.write(wide(reg), value);
+    return 0;
+}
+
+uint16_t sim8086_get_flags(const sim8086 *sim) { return sim->runner.get_flags().word(); }
+void sim8086_set_flags(sim8086 *sim, uint16_t value) { sim->runner.get_flags().set_word(value); }
+uint16_t sim8086_get_ip(const sim8086 *sim) { return sim->runner.get_ip(); }
+void sim8086_set_ip(sim8086 *sim, uint16_t value) { sim->runner.set_ip(value); }
+
+uint8_t *sim8086_memory(sim8086 *sim, size_t *size) {
+    const auto memory = sim->runner.get_memory();
+    if (size)
+        *size = memory.size();
+    return memory.data();
+}
+
+const char *sim8086_mnemonic_name(uint8_t mnemonic) {
+    // NOTE(louis): every name is a literal, so the views are null-terminated
+    if (mnemonic >= sim::instructions::MNEMONIC_NAMES.size())
+        return nullptr;
+    return sim::instructions::MNEMONIC_NAMES[mnemonic].data();
+}
+
+} // extern "C"
@@ -0,0 +1,111 @@
+#ifndef SIM8086_H
+#define SIM8086_H
+
+/*
+ * C interface to libsim8086.
+ *
+ * Code and data share one guest address space with the image loaded at address 0. Nothing in
+ * here prints; every result comes back as a struct or plain value.
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct sim8086 sim8086;
+
+/* Register numbers follow the 8086 encoding, segment registers come after in sr order */
+typedef enum sim8086_register {
+    SIM8086_AX = 0,
+    SIM8086_CX,
+    SIM8086_DX,
+    SIM8086_BX,
+    SIM8086_SP,
+    SIM8086_BP,
+    SIM8086_SI,
+    SIM8086_DI,
+    SIM8086_ES,
+    SIM8086_CS,
+    SIM8086_SS,
+    SIM8086_DS,
+} sim8086_register;
+
+typedef enum sim8086_stop_reason {
+    SIM8086_STOP_HALTED = 0,
+    SIM8086_STOP_DECODE_ERROR,
+    SIM8086_STOP_IP,
+    SIM8086_STOP_CYCLES,
+    SIM8086_STOP_INSTRUCTIONS,
+    SIM8086_STOP_CODE_SEGMENT, /* something tried to load cs with anything but 0 */
+} sim8086_stop_reason;
+
+/* Which fields of sim8086_limits are set */
+enum {
+    SIM8086_UNTIL_IP = 1 << 0,
+    SIM8086_UNTIL_CYCLES = 1 << 1,
+    SIM8086_UNTIL_INSTRUCTIONS = 1 << 2,
+};
+
+typedef struct sim8086_limits {
+    uint32_t mask;
+    uint16_t ip;
+    uint64_t cycles;       /* total since creation */
+    uint64_t instructions; /* total since creation */
+} sim8086_limits;
+
+typedef struct sim8086_run_result {
+    sim8086_stop_reason reason;
+    uint16_t ip;
+    uint64_t instructions;
+    uint64_t cycles;
+} sim8086_run_result;
+
+typedef struct sim8086_instruction {
+    uint16_t address;
+    uint8_t size;
+    uint8_t mnemonic; /* see sim8086_mnemonic_name */
+} sim8086_instruction;
+
+/*
+ * All of these return NULL on failure.
+ *
+ * sim8086_create copies the image into fresh guest memory. sim8086_create_from_file maps the
+ * file copy-on-write instead, without copying. sim8086_create_in_place runs directly in
+ * caller-owned memory of at least 64K that already holds the image; it has to outlive the
+ * simulator.
+ */
+sim8086 *sim8086_create(const uint8_t *image, size_t size);
+sim8086 *sim8086_create_from_file(const char *path);
+sim8086 *sim8086_create_in_place(uint8_t *memory, size_t memory_size, size_t image_size);
+void sim8086_destroy(sim8086 *sim);
+
+/*
+ * Executes one instruction. Returns 0 on success, -1 if ip doesn't decode, -2 if it would load cs
+ * with anything but 0 and 1 if halted.
+ */
+int sim8086_step(sim8086 *sim, sim8086_instruction *out);
+sim8086_run_result sim8086_run_until(sim8086 *sim, const sim8086_limits *limits);
+/* Analyses control flow from the current ip so run_until can skip flags nothing reads */
+void sim8086_analyse(sim8086 *sim);
+
+uint16_t sim8086_get_register(const sim8086 *sim, sim8086_register reg);
+/* Returns 0, or -2 and leaves the register alone if it would load cs with anything but 0 */
+int sim8086_set_register(sim8086 *sim, sim8086_register reg, uint16_t value);
+uint16_t sim8086_get_flags(const sim8086 *sim);
+void sim8086_set_flags(sim8086 *sim, uint16_t value);
+uint16_t sim8086_get_ip(const sim8086 *sim);
+void sim8086_set_ip(sim8086 *sim, uint16_t value);
+
+/* The whole guest address space, writable in place */
+uint8_t *sim8086_memory(sim8086 *sim, size_t *size);
+
+const char *sim8086_mnemonic_name(uint8_t mnemonic);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* SIM8086_H */
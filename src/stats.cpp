@@ -0,0 +1,183 @@
+#include "common.hpp"
+
+#include "stats.hpp"
+
+#include <algorithm>
+#include <sstream>
+#include <utility>
+
+namespace sim::stats {
+
+namespace {
+    constexpr std::array<std::string_view, 5> OPERAND_NAMES = {
+        "register", "segment", "memory", "immediate", "relative",
+    };
+
+    std::string address_name(std::size_t form) {
+        if (form == registers::EFFECTIVE_ADDRESSES.size())
+            return "direct";
+
+        const auto [base, index] = registers::EFFECTIVE_ADDRESSES[form];
+        std::string name(registers::REG_NAMES[base]);
+        if (index != registers::NONE) {
+            name += " + ";
+            name += registers::REG_NAMES[index];
+        }
+        return name;
+    }
+
+    // NOTE(louis): image paths are the only strings that come from outside
+    std::string quoted(std::string_view s) {
+        std::string result = "\"";
+        for (const char c : s) {
+            if (c == '"' || c == '\\') {
+                result += '\\';
+                result += c;
+            } else if (static_cast<unsigned char>(c) < 0x20) {
+                constexpr char HEX[] = "0123456789abcdef";
+                result += "\\u00";
+                result += HEX[c >> 4];
+                result += HEX[c & 0xF];
+            } else {
+                result += c;
+            }
+        }
+        return result + '"';
+    }
+} // namespace
+
+void ReuseDistance::access(std::uint32_t address) noexcept {
+    const std::uint32_t line = (address & (image::GuestMemory::SIZE - 1)) >> LINE_BITS;
+    if (now == CAPACITY)
+        renumber();
+    const std::uint32_t time = ++now;
+
+    if (last[line] == 0) {
+        cold++;
+    } else {
+        // lines whose latest access came after this one's
+        const std::uint32_t distance = marked_up_to(time - 1) - marked_up_to(last[line]);
+        buckets[std::bit_width(distance)]++;
+        mark(last[line], -1);
+    }
+
+    mark(time, 1);
+    last[line] = time;
+}
+
+void ReuseDistance::mark(std::uint32_t time, int delta) noexcept {
+    for (; time <= CAPACITY; time += time & -time)
+        marks[time] += delta;
+}
+
+std::uint32_t ReuseDistance::marked_up_to(std::uint32_t time) const noexcept {
+    std::uint32_t count = 0;
+    for (; time > 0; time -= time & -time)
+        count += marks[time];
+    return count;
+}
+
+void ReuseDistance::renumber() noexcept {
+    // only the order of each line's latest access matters, so squeeze them down to 1..n
+    std::vector<std::pair<std::uint32_t, std::uint32_t>> touched; // (time, line)
+    for (std::uint32_t line = 0; line < LINES; line++) {
+        if (last[line] != 0)
+            touched.emplace_back(last[line], line);
+    }
+    std::sort(touched.begin(), touched.end());
+
+    std::fill(marks.begin(), marks.end(), 0);
+    now = 0;
+    for (const auto &[time, line] : touched) {
+        last[line] = ++now;
+        mark(now, 1);
+    }
+}
+
+void Stats::retire(const instructions::Instruction &inst, bool branched) noexcept {
+    using instructions::Mnemonic;
+
+    instructions++;
+    mnemonics[inst.mnemonic]++;
+    operand(inst.dst);
+    operand(inst.src);
+
+    if (inst.mnemonic >= Mnemonic::JE && inst.mnemonic <= Mnemonic::JCXZ)
+        branches[inst.mnemonic - Mnemonic::JE][branched]++;
+}
+
+void Stats::operand(const instructions::Operand &operand) noexcept {
+    using Type = instructions::Operand::Type;
+
+    if (operand.type == Type::NONE)
+        return;
+    operands[static_cast<std::size_t>(operand.type)]++;
+
+    if (operand.type != Type::MEMORY)
+        return;
+
+    const auto &terms = operand.mem_access.terms;
+    std::size_t form = 0;
+    while (form < registers::EFFECTIVE_ADDRESSES.size() &&
+           registers::EFFECTIVE_ADDRESSES[form] != std::pair{terms[0].index, terms[1].index})
+        form++;
+    addresses[form]++;
+}
+
+std::string Stats::json(std::string_view image) const noexcept {
+    std::stringstream ss;
+    ss << "{\"image\": " << quoted(image) << ", \"instructions\": " << instructions;
+
+    const char *separator = "";
+    ss << ", \"mnemonics\": {";
+    for (std::size_t i = 0; i < mnemonics.size(); i++) {
+        if (mnemonics[i] == 0)
+            continue;
+        ss << std::exchange(separator, ", ") << quoted(instructions::MNEMONIC_NAMES[i]) << ": "
+           << mnemonics[i];
+    }
+
+    separator = "";
+    ss << "}, \"operands\": {";
+    for (std::size_t i = 0; i < operands.size(); i++)
+        ss << std::exchange(separator, ", ") << quoted(OPERAND_NAMES[i]) << ": " << operands[i];
+
+    separator = "";
+    ss << "}, \"effective_addresses\": {";
+    for (std::size_t i = 0; i < addresses.size(); i++)
+        ss << std::exchange(separator, ", ") << quoted(address_name(i)) << ": " << addresses[i];
+
+    separator = "";
+    ss << "}, \"branches\": {";
+    for (std::size_t i = 0; i < branches.size(); i++) {
+        const auto [not_taken, taken] = branches[i];
+        if (taken + not_taken == 0)
+            continue;
+        const auto name = instructions::MNEMONIC_NAMES[instructions::Mnemonic::JE + i];
+        ss << std::exchange(separator, ", ") << quoted(name) << ": {\"taken\": " << taken
+           << ", \"not_taken\": " << not_taken << '}';
+    }
+
+    // keyed by the least distance each bucket holds
+    const auto &buckets = reuse.get_buckets();
+    ss << "}, \"accesses\": " << accesses
+       << ", \"reuse_distance\": {\"cold\": " << reuse.get_cold();
+    for (std::size_t k = 0; k < buckets.size(); k++)
+        ss << ", \"" << (k == 0 ? 0 : 1u << (k - 1)) << "\": " << buckets[k];
+
+    // an LRU cache of 2^k lines hits exactly the accesses in buckets 0..k
+    separator = "";
+    ss << "}, \"working_set\": [";
+    std::uint64_t hits = 0;
+    for (std::size_t k = 0; k < buckets.size() && accesses != 0; k++) {
+        hits += buckets[k];
+        ss << std::exchange(separator, ", ") << "{\"bytes\": "
+           << (std::uint64_t{1} << (k + ReuseDistance::LINE_BITS))
+           << ", \"miss_ratio\": " << static_cast<double>(accesses - hits) / accesses << '}';
+    }
+    ss << "]}";
+
+    return ss.str();
+}
+
+} // namespace sim::stats
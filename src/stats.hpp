@@ -0,0 +1,83 @@
+#pragma once
+
+#include "common.hpp"
+
+#include "image.hpp"
+#include "instructions.hpp"
+#include "registers.hpp"
+
+#include <array>
+#include <bit>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Workload characterisation for one run: instruction mix, operand and addressing forms, branch
+// outcomes and data locality. Everything is a plain count, so runs aggregate by adding them up.
+
+namespace sim::stats {
+
+// LRU stack distance of every data access over 64-byte lines: how many other lines were touched
+// since the last access to this one. Bucket 0 is distance 0, bucket k is [2^(k-1), 2^k).
+class ReuseDistance {
+public:
+    static constexpr std::uint32_t LINE_BITS = 6;
+    static constexpr std::uint32_t LINES = image::GuestMemory::SIZE >> LINE_BITS;
+    static constexpr std::size_t BUCKETS = std::bit_width(LINES - 1) + 1;
+
+    ReuseDistance() : last(LINES, 0), marks(CAPACITY + 1, 0) {}
+
+    void access(std::uint32_t address) noexcept;
+
+    [[nodiscard]] std::uint64_t get_cold() const noexcept { return cold; }
+    [[nodiscard]] const std::array<std::uint64_t, BUCKETS> &get_buckets() const noexcept {
+        return buckets;
+    }
+
+private:
+    // NOTE(louis): timestamps are renumbered once they run out, so the tree stays this size
+    static constexpr std::uint32_t CAPACITY = 4 * LINES;
+
+    std::vector<std::uint32_t> last;  // per line, the time of its latest access, 0 if never
+    std::vector<std::uint32_t> marks; // Fenwick tree over time, 1 where a line was last accessed
+    std::uint32_t now = 0;
+
+    std::uint64_t cold = 0;
+    std::array<std::uint64_t, BUCKETS> buckets = {};
+
+    void mark(std::uint32_t time, int delta) noexcept;
+    [[nodiscard]] std::uint32_t marked_up_to(std::uint32_t time) const noexcept;
+    void renumber() noexcept;
+};
+
+class Stats {
+public:
+    // branched is whether ip ended up anywhere but the next instruction
+    void retire(const instructions::Instruction &inst, bool branched) noexcept;
+    void access(std::uint32_t address) noexcept {
+        accesses++;
+        reuse.access(address);
+    }
+
+    // One line of JSON, with a working set curve (LRU miss ratio by size) worked out from the
+    // reuse distances
+    [[nodiscard]] std::string json(std::string_view image) const noexcept;
+
+private:
+    static constexpr std::size_t BRANCHES =
+        instructions::Mnemonic::JCXZ - instructions::Mnemonic::JE + 1;
+
+    std::uint64_t instructions = 0;
+    std::uint64_t accesses = 0;
+    std::array<std::uint64_t, instructions::MNEMONIC_NAMES.size()> mnemonics = {};
+    std::array<std::uint64_t, 5> operands = {}; // by Operand::Type, NONE left out
+    // by EFFECTIVE_ADDRESSES, then direct addresses last
+    std::array<std::uint64_t, registers::EFFECTIVE_ADDRESSES.size() + 1> addresses = {};
+    std::array<std::array<std::uint64_t, 2>, BRANCHES> branches = {}; // not taken, taken
+    ReuseDistance reuse;
+
+    void operand(const instructions::Operand &operand) noexcept;
+};
+
+} // namespace sim::stats
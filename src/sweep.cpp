@@ -0,0 +1,171 @@
+#include "common.hpp"
+
+#include "stats.hpp"
+#include "sweep.hpp"
+
+#include <charconv>
+#include <map>
+#include <memory>
+#include <thread>
+
+namespace sim::sweep {
+
+namespace {
+    // decimal or 0x-prefixed hex
+    std::optional<std::uint32_t> parse_number(std::string_view s) noexcept {
+        int base = 10;
+        if (s.size() > 2 && s[0] == '0' && (s[1] == 'x' || s[1] == 'X')) {
+            base = 16;
+            s.remove_prefix(2);
+        }
+
+        std::uint32_t value = 0;
+        const auto [end, ec] = std::from_chars(s.data(), s.data() + s.size(), value, base);
+        if (ec != std::errc{} || end != s.data() + s.size())
+            return std::nullopt;
+        return value;
+    }
+
+    std::optional<registers::RegAccess> lookup(std::string_view name) noexcept {
+        for (u8 i = 0; i < registers::REG_NAMES.size(); i++) {
+            if (name == registers::REG_NAMES[i])
+                return registers::RegAccess{i, true};
+        }
+
+        for (u8 i = 0; i < registers::REG_NAMES_LOW.size(); i++) {
+            if (name == registers::REG_NAMES_LOW[i])
+                return registers::RegAccess{i, false};
+            if (name == registers::REG_NAMES_HIGH[i])
+                return registers::RegAccess{static_cast<u8>(i | 0b100), false};
+        }
+
+        return std::nullopt;
+    }
+
+    constexpr std::size_t QUEUE_SIZE = 1024;
+
+    void work(const image::SharedImage &image, std::span<const Parameter> parameters,
+              const Options &options, std::atomic<std::uint64_t> &next, std::uint64_t total,
+              Queue<Outcome, QUEUE_SIZE> &queue) noexcept {
+        for (;;) {
+            const std::uint64_t run = next.fetch_add(1, std::memory_order_relaxed);
+            if (run >= total)
+                return;
+
+            Outcome outcome{run, std::nullopt, {}, {}, {}};
+            if (auto memory = image.instance()) {
+                runner::Runner runner(std::move(*memory));
+
+                // NOTE(louis): per run, so the counts aren't shared between workers
+                std::optional<stats::Stats> run_stats;
+                if (options.stats)
+                    runner.attach_stats(run_stats.emplace());
+
+                const auto run_values = values(parameters, run);
+                for (std::size_t i = 0; i < parameters.size(); i++) {
+                    if (parameters[i].reg)
+                        runner.get_registers().write(*parameters[i].reg, run_values[i]);
+                    else
+                        runner.get_memory()[parameters[i].address] = run_values[i];
+                }
+
+                // NOTE(louis): after the writes, since a swept byte can be code
+                runner.analyse();
+                outcome.result = runner.run_until(options.limits);
+                outcome.registers = runner.get_registers();
+                outcome.flags = runner.get_flags();
+                if (run_stats)
+                    outcome.stats = run_stats->json(*options.stats);
+            }
+
+            queue.push(outcome);
+        }
+    }
+} // namespace
+
+std::optional<Parameter> Parameter::parse(std::string_view text) noexcept {
+    const auto equals = text.find('=');
+    if (equals == std::string_view::npos)
+        return std::nullopt;
+
+    const std::string_view target = text.substr(0, equals);
+    const std::string_view range = text.substr(equals + 1);
+
+    Parameter parameter;
+    if (target.size() > 2 && target.front() == '[' && target.back() == ']') {
+        const auto address = parse_number(target.substr(1, target.size() - 2));
+        if (!address || *address >= image::GuestMemory::SIZE)
+            return std::nullopt;
+        parameter.address = *address;
+    } else if (!(parameter.reg = lookup(target))) {
+        return std::nullopt;
+    }
+
+    const auto colon = range.find(':');
+    const auto first = parse_number(range.substr(0, colon));
+    const auto last =
+        colon == std::string_view::npos ? first : parse_number(range.substr(colon + 1));
+
+    const std::uint32_t limit = parameter.reg && parameter.reg->is_wide ? 0xFFFF : 0xFF;
+    if (!first || !last || *first > *last || *last > limit)
+        return std::nullopt;
+
+    parameter.first = *first;
+    parameter.last = *last;
+    return parameter;
+}
+
+std::string Parameter::name() const noexcept {
+    if (reg)
+        return registers::RegAccess::string(*reg);
+
+    char text[16];
+    const auto [end, ec] = std::to_chars(text, text + sizeof(text), address, 16);
+    return "[0x" + std::string(text, end) + "]";
+}
+
+std::uint64_t combinations(std::span<const Parameter> parameters) noexcept {
+    std::uint64_t total = 1;
+    for (const Parameter &parameter : parameters)
+        total *= parameter.count();
+    return total;
+}
+
+std::vector<u16> values(std::span<const Parameter> parameters, std::uint64_t run) noexcept {
+    std::vector<u16> result(parameters.size());
+    for (std::size_t i = parameters.size(); i-- > 0;) {
+        result[i] = parameters[i].first + run % parameters[i].count();
+        run /= parameters[i].count();
+    }
+    return result;
+}
+
+void run(const image::SharedImage &image, std::span<const Parameter> parameters,
+         const Options &options, const std::function<void(const Outcome &)> &report) noexcept {
+    const std::uint64_t total = combinations(parameters);
+
+    // NOTE(louis): on the heap, it's a thousand outcomes wide
+    auto queue = std::make_unique<Queue<Outcome, QUEUE_SIZE>>();
+    std::atomic<std::uint64_t> next = 0;
+
+    std::vector<std::jthread> workers;
+    for (unsigned i = 0; i < std::max(options.threads, 1u); i++)
+        workers.emplace_back(work, std::cref(image), parameters, std::cref(options), std::ref(next),
+                             total, std::ref(*queue));
+
+    // outcomes arrive in whatever order the workers finish them, and are reported in run order
+    std::map<std::uint64_t, Outcome> pending;
+    std::uint64_t reported = 0;
+    while (reported < total) {
+        Outcome outcome = queue->pop();
+
+        pending.emplace(outcome.run, std::move(outcome));
+        for (auto it = pending.begin(); it != pending.end() && it->first == reported;
+             it = pending.erase(it)) {
+            report(it->second);
+            reported++;
+        }
+    }
+}
+
+} // namespace sim::sweep
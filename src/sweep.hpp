@@ -0,0 +1,157 @@
+#pragma once
+
+#include "common.hpp"
+
+#include "flags.hpp"
+#include "image.hpp"
+#include "registers.hpp"
+#include "runner.hpp"
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <optional>
+#include <span>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+// Runs one image many times over, once for every combination of a few initial register or memory
+// values. Workers each map their own copy-on-write instance of the image per run and hand what
+// happened back through a lock-free queue.
+
+namespace sim::sweep {
+
+// A register, or a byte of memory, taking every value in [first, last]
+struct Parameter {
+    std::optional<registers::RegAccess> reg;
+    std::uint32_t address = 0; // when reg is empty
+    u16 first = 0;
+    u16 last = 0;
+
+    // "ax=0:15", "bl=3" or "[0x1200]=0:0xff"
+    [[nodiscard]] static std::optional<Parameter> parse(std::string_view text) noexcept;
+
+    [[nodiscard]] std::size_t count() const noexcept { return last - first + 1; }
+    [[nodiscard]] std::string name() const noexcept;
+};
+
+// Every combination of the parameters' values, the last parameter varying fastest
+[[nodiscard]] std::uint64_t combinations(std::span<const Parameter> parameters) noexcept;
+[[nodiscard]] std::vector<u16> values(std::span<const Parameter> parameters,
+                                      std::uint64_t run) noexcept;
+
+struct Options {
+    runner::Limits limits; // for each run
+    unsigned threads = 1;
+    // Collects stats::Stats on every run, reported as a line of JSON naming this image
+    std::optional<std::string> stats;
+};
+
+struct Outcome {
+    std::uint64_t run;
+    std::optional<runner::RunResult> result; // empty if the image couldn't be mapped
+    registers::RegFile registers;            // as the run left them
+    flags::FlagState flags;
+    std::string stats; // empty unless asked for
+};
+
+// Bounded queue for many producers and a single consumer. Each slot's sequence number says whose
+// turn it is: pushing claims a position with a CAS on head and publishes by bumping the sequence,
+// and the consumer hands the slot back a lap later. The blocking forms sleep on a count of the
+// other side's progress, so nobody spins while the queue is empty or full.
+template <typename T, std::size_t CAPACITY> class Queue {
+    static_assert((CAPACITY & (CAPACITY - 1)) == 0, "capacity has to be a power of two");
+
+public:
+    Queue() noexcept {
+        for (std::size_t i = 0; i < CAPACITY; i++)
+            slots[i].sequence.store(i, std::memory_order_relaxed);
+    }
+
+    // false when full
+    [[nodiscard]] bool try_push(const T &value) noexcept {
+        std::size_t position = head.load(std::memory_order_relaxed);
+        for (;;) {
+            Slot &slot = slots[position & (CAPACITY - 1)];
+            const std::size_t sequence = slot.sequence.load(std::memory_order_acquire);
+            const auto lag = static_cast<std::ptrdiff_t>(sequence - position);
+
+            if (lag == 0) {
+                if (head.compare_exchange_weak(position, position + 1, std::memory_order_relaxed)) {
+                    slot.value = value;
+                    slot.sequence.store(position + 1, std::memory_order_release);
+                    return true;
+                }
+            } else if (lag < 0) {
+                return false;
+            } else {
+                position = head.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+    void push(const T &value) noexcept {
+        for (;;) {
+            const std::uint32_t seen = popped.load(std::memory_order_acquire);
+            if (try_push(value))
+                break;
+            popped.wait(seen, std::memory_order_acquire);
+        }
+
+        pushed.fetch_add(1, std::memory_order_release);
+        pushed.notify_one();
+    }
+
+    // Consumer side only
+    [[nodiscard]] T pop() noexcept {
+        for (;;) {
+            // NOTE(louis): a count that moved means some slot was published, not necessarily the
+            // next one, so this can go round again until the producer that owns it catches up
+            const std::uint32_t seen = pushed.load(std::memory_order_acquire);
+            if (auto value = try_pop()) {
+                popped.fetch_add(1, std::memory_order_release);
+                popped.notify_all();
+                return std::move(*value);
+            }
+            pushed.wait(seen, std::memory_order_acquire);
+        }
+    }
+
+    // Consumer side only
+    [[nodiscard]] std::optional<T> try_pop() noexcept {
+        Slot &slot = slots[tail & (CAPACITY - 1)];
+        if (slot.sequence.load(std::memory_order_acquire) != tail + 1)
+            return std::nullopt;
+
+        T value = std::move(slot.value);
+        slot.sequence.store(tail + CAPACITY, std::memory_order_release);
+        tail++;
+        return value;
+    }
+
+private:
+    struct Slot {
+        std::atomic<std::size_t> sequence;
+        T value;
+    };
+
+    std::array<Slot, CAPACITY> slots;
+    alignas(64) std::atomic<std::size_t> head = 0;
+    alignas(64) std::size_t tail = 0;
+
+    // only compared for change, so wrapping is fine
+    alignas(64) std::atomic<std::uint32_t> pushed = 0;
+    alignas(64) std::atomic<std::uint32_t> popped = 0;
+};
+
+// Runs every combination on the options' worker threads, each until it halts or hits the limits.
+// report is called on the calling thread, once per run and in run order, while the workers carry
+// on.
+void run(const image::SharedImage &image, std::span<const Parameter> parameters,
+         const Options &options, const std::function<void(const Outcome &)> &report) noexcept;
+
+} // namespace sim::sweep
@@ -3,63 +3,371 @@
 #include "instructions.hpp"
 #include "table.hpp"
 
-#include <vector>
+#include <array>
+#include <bit>
+#include <string_view>
 
 namespace sim::decode::table {
 
+// Each encoding is the opcode byte, then the mod reg r/m byte for those that have one, written
+// out bit by bit from the top as in the Intel manual:
+//
+//   0 1        bits that have to match
+//   d s w v    one bit flags (v is the shift's count-in-cl bit, kept in d)
+//   mod r/m    two and three bit fields of the second byte
+//   reg        a register in the opcode (01000reg) or the second byte
+//   sr         a segment register, kept in reg
+//
+// Spaces are ignored. Anything after a '|' gives fields the encoding doesn't hold a value for,
+// as in "d=1 w=1". Patterns are parsed at compile time, and a bad one won't compile.
+
 namespace {
-    constexpr auto NONE = BitField{0x00, 0};
-    constexpr auto D(u8 x) { return BitField::create(x); }
-    constexpr auto S(u8 x) { return BitField::create(x); }
-    constexpr auto W(u8 x) { return BitField::create(x); }
-    constexpr auto MOD(u8 x) { return BitField::create(x); }
-    constexpr auto REG(u8 x) { return BitField::create(x); }
-    constexpr auto RM(u8 x) { return BitField::create(x); }
-
-    constexpr auto FIRST(u8 mask, u8 equals) { return MatchCondition::create(mask, equals); }
-    constexpr auto SECOND(u8 mask, u8 equals) { return MatchCondition::create(mask, equals); }
-    constexpr auto NO_MATCH = MatchCondition::none();
+    using instructions::Mnemonic;
+    using Type = Encoding::Type;
+
+    struct Field {
+        std::string_view name;
+        BitField Encoding::*member;
+        u8 width;
+    };
+
+    // NOTE(louis): longest names first, so "sr" isn't read as an s flag
+    constexpr std::array<Field, 8> FIELDS = {{
+        {"mod", &Encoding::mod, 2},
+        {"reg", &Encoding::reg, 3},
+        {"r/m", &Encoding::rm, 3},
+        {"sr", &Encoding::reg, 2},
+        {"d", &Encoding::d, 1},
+        {"s", &Encoding::s, 1},
+        {"w", &Encoding::w, 1},
+        {"v", &Encoding::d, 1},
+    }};
+
+    [[noreturn]] void invalid_pattern(const char *) {
+        // NOTE(louis): not constexpr, so reaching this during constant evaluation is the error
+        UNREACHABLE();
+    }
+
+    consteval Encoding encode(Mnemonic mnemonic, std::string_view pattern, Type type) {
+        Encoding encoding{};
+        encoding.mnemonic = mnemonic;
+        encoding.type = type;
+
+        const std::size_t bar = pattern.find('|');
+        std::string_view bits = pattern.substr(0, bar);
+
+        // which byte each field came from, or -1
+        std::array<int, FIELDS.size()> seen{};
+        seen.fill(-1);
+
+        int position = 0;
+        while (!bits.empty()) {
+            if (bits.front() == ' ') {
+                bits.remove_prefix(1);
+                continue;
+            }
+
+            const int byte = position / 8;
+            if (byte > 1)
+                invalid_pattern("more than two bytes");
+            MatchCondition &match = byte == 0 ? encoding.first : encoding.second;
+
+            if (bits.front() == '0' || bits.front() == '1') {
+                const u8 bit = 1 << (7 - position % 8);
+                match.mask |= bit;
+                match.equals |= bits.front() == '1' ? bit : 0;
+                bits.remove_prefix(1);
+                position++;
+                continue;
+            }
+
+            std::size_t i = 0;
+            while (i < FIELDS.size() && !bits.starts_with(FIELDS[i].name))
+                i++;
+            if (i == FIELDS.size())
+                invalid_pattern("unknown field");
+
+            const Field &field = FIELDS[i];
+            if (position % 8 + field.width > 8)
+                invalid_pattern("field crosses a byte");
+            for (std::size_t j = 0; j < FIELDS.size(); j++) {
+                if (seen[j] != -1 && FIELDS[j].member == field.member)
+                    invalid_pattern("field given twice");
+            }
+
+            const u8 shift = 8 - position % 8 - field.width;
+            encoding.*field.member = BitField{
+                .mask = static_cast<u8>(((1 << field.width) - 1) << shift),
+                .shift = shift,
+            };
+            seen[i] = byte;
+            bits.remove_prefix(field.name.size());
+            position += field.width;
+        }
+
+        if (position != (Encoding::has_modrm(type) ? 16 : 8))
+            invalid_pattern("wrong length for the type");
+
+        // flags come from the opcode, mod and r/m from the second byte
+        for (std::size_t i = 0; i < FIELDS.size(); i++) {
+            const bool second = FIELDS[i].member == &Encoding::mod ||
+                                FIELDS[i].member == &Encoding::rm;
+            const bool flag = FIELDS[i].width == 1;
+            if ((second && seen[i] == 0) || (flag && seen[i] == 1))
+                invalid_pattern("field in the wrong byte");
+        }
+        if (Encoding::has_modrm(type) && (!encoding.mod.mask || !encoding.rm.mask))
+            invalid_pattern("mod r/m byte without mod and r/m");
+
+        if (bar == std::string_view::npos)
+            return encoding;
+
+        std::string_view implied = pattern.substr(bar + 1);
+        while (!implied.empty()) {
+            if (implied.front() == ' ') {
+                implied.remove_prefix(1);
+                continue;
+            }
+
+            std::size_t i = 0;
+            while (i < FIELDS.size() && !implied.starts_with(FIELDS[i].name))
+                i++;
+            if (i == FIELDS.size() || FIELDS[i].width != 1)
+                invalid_pattern("only flags can be implied");
+
+            BitField &field = encoding.*FIELDS[i].member;
+            implied.remove_prefix(FIELDS[i].name.size());
+            if (field.mask || implied.size() < 2 || implied[0] != '=' ||
+                (implied[1] != '0' && implied[1] != '1'))
+                invalid_pattern("implied flags are written d=1, and can't also be encoded");
+
+            field.implied = implied[1] - '0';
+            implied.remove_prefix(2);
+        }
+
+        return encoding;
+    }
+
+    // clang-format off
+    constexpr auto ENCODINGS = std::to_array<Encoding>({
+        encode(Mnemonic::MOV,    "100010dw mod reg r/m",      Type::RM_WITH_REG),
+        encode(Mnemonic::MOV,    "1100011w mod 000 r/m",      Type::IMM_WITH_RM),
+        encode(Mnemonic::MOV,    "1011wreg",                  Type::IMM_TO_REG),
+        encode(Mnemonic::MOV,    "100011d0 mod 0sr r/m",      Type::SEGMENT_WITH_RM),
+
+        encode(Mnemonic::ADD,    "000000dw mod reg r/m",      Type::RM_WITH_REG),
+        encode(Mnemonic::ADD,    "100000sw mod 000 r/m",      Type::IMM_WITH_RM),
+        encode(Mnemonic::ADD,    "0000010w",                  Type::IMM_WITH_ACC),
+
+        encode(Mnemonic::SUB,    "001010dw mod reg r/m",      Type::RM_WITH_REG),
+        encode(Mnemonic::SUB,    "100000sw mod 101 r/m",      Type::IMM_WITH_RM),
+        encode(Mnemonic::SUB,    "0010110w",                  Type::IMM_WITH_ACC),
+
+        encode(Mnemonic::CMP,    "001110dw mod reg r/m",      Type::RM_WITH_REG),
+        encode(Mnemonic::CMP,    "100000sw mod 111 r/m",      Type::IMM_WITH_RM),
+        encode(Mnemonic::CMP,    "0011110w",                  Type::IMM_WITH_ACC),
+
+        encode(Mnemonic::ADC,    "000100dw mod reg r/m",      Type::RM_WITH_REG),
+        encode(Mnemonic::ADC,    "100000sw mod 010 r/m",      Type::IMM_WITH_RM),
+        encode(Mnemonic::ADC,    "0001010w",                  Type::IMM_WITH_ACC),
+
+        encode(Mnemonic::SBB,    "000110dw mod reg r/m",      Type::RM_WITH_REG),
+        encode(Mnemonic::SBB,    "100000sw mod 011 r/m",      Type::IMM_WITH_RM),
+        encode(Mnemonic::SBB,    "0001110w",                  Type::IMM_WITH_ACC),
+
+        encode(Mnemonic::AND,    "001000dw mod reg r/m",      Type::RM_WITH_REG),
+        encode(Mnemonic::AND,    "100000sw mod 100 r/m",      Type::IMM_WITH_RM),
+        encode(Mnemonic::AND,    "0010010w",                  Type::IMM_WITH_ACC),
+
+        encode(Mnemonic::OR,     "000010dw mod reg r/m",      Type::RM_WITH_REG),
+        encode(Mnemonic::OR,     "100000sw mod 001 r/m",      Type::IMM_WITH_RM),
+        encode(Mnemonic::OR,     "0000110w",                  Type::IMM_WITH_ACC),
+
+        encode(Mnemonic::XOR,    "001100dw mod reg r/m",      Type::RM_WITH_REG),
+        encode(Mnemonic::XOR,    "100000sw mod 110 r/m",      Type::IMM_WITH_RM),
+        encode(Mnemonic::XOR,    "0011010w",                  Type::IMM_WITH_ACC),
+
+        encode(Mnemonic::TEST,   "1000010w mod reg r/m",      Type::RM_WITH_REG),
+        encode(Mnemonic::TEST,   "1111011w mod 000 r/m",      Type::IMM_WITH_RM),
+        encode(Mnemonic::TEST,   "1010100w",                  Type::IMM_WITH_ACC),
+
+        encode(Mnemonic::NOT,    "1111011w mod 010 r/m",      Type::RM),
+        encode(Mnemonic::NEG,    "1111011w mod 011 r/m",      Type::RM),
+        encode(Mnemonic::MUL,    "1111011w mod 100 r/m",      Type::RM),
+        encode(Mnemonic::IMUL,   "1111011w mod 101 r/m",      Type::RM),
+        encode(Mnemonic::DIV,    "1111011w mod 110 r/m",      Type::RM),
+        encode(Mnemonic::IDIV,   "1111011w mod 111 r/m",      Type::RM),
+
+        encode(Mnemonic::INC,    "1111111w mod 000 r/m",      Type::RM),
+        encode(Mnemonic::INC,    "01000reg",                  Type::REG),
+        encode(Mnemonic::DEC,    "1111111w mod 001 r/m",      Type::RM),
+        encode(Mnemonic::DEC,    "01001reg",                  Type::REG),
+
+        encode(Mnemonic::ROL,    "110100vw mod 000 r/m",      Type::SHIFT),
+        encode(Mnemonic::ROR,    "110100vw mod 001 r/m",      Type::SHIFT),
+        encode(Mnemonic::RCL,    "110100vw mod 010 r/m",      Type::SHIFT),
+        encode(Mnemonic::RCR,    "110100vw mod 011 r/m",      Type::SHIFT),
+        encode(Mnemonic::SHL,    "110100vw mod 100 r/m",      Type::SHIFT),
+        encode(Mnemonic::SHR,    "110100vw mod 101 r/m",      Type::SHIFT),
+        encode(Mnemonic::SAR,    "110100vw mod 111 r/m",      Type::SHIFT),
+
+        // NOTE(louis): nop is xchg ax, ax, and wins for being the more specific of the two
+        encode(Mnemonic::NOP,    "10010000",                  Type::NO_OPERANDS),
+        encode(Mnemonic::XCHG,   "1000011w mod reg r/m",      Type::RM_WITH_REG),
+        encode(Mnemonic::XCHG,   "10010reg",                  Type::REG_WITH_ACC),
+        encode(Mnemonic::LEA,    "10001101 mod reg r/m | d=1 w=1", Type::RM_WITH_REG),
+        encode(Mnemonic::CBW,    "10011000",                  Type::NO_OPERANDS),
+        encode(Mnemonic::CWD,    "10011001",                  Type::NO_OPERANDS),
+
+        encode(Mnemonic::CLC,    "11111000",                  Type::NO_OPERANDS),
+        encode(Mnemonic::STC,    "11111001",                  Type::NO_OPERANDS),
+        encode(Mnemonic::CMC,    "11110101",                  Type::NO_OPERANDS),
+
+        encode(Mnemonic::JE,     "01110100",                  Type::JUMP),
+        encode(Mnemonic::JL,     "01111100",                  Type::JUMP),
+        encode(Mnemonic::JLE,    "01111110",                  Type::JUMP),
+        encode(Mnemonic::JB,     "01110010",                  Type::JUMP),
+        encode(Mnemonic::JBE,    "01110110",                  Type::JUMP),
+        encode(Mnemonic::JP,     "01111010",                  Type::JUMP),
+        encode(Mnemonic::JO,     "01110000",                  Type::JUMP),
+        encode(Mnemonic::JS,     "01111000",                  Type::JUMP),
+        encode(Mnemonic::JNE,    "01110101",                  Type::JUMP),
+        encode(Mnemonic::JNL,    "01111101",                  Type::JUMP),
+        encode(Mnemonic::JG,     "01111111",                  Type::JUMP),
+        encode(Mnemonic::JNB,    "01110011",                  Type::JUMP),
+        encode(Mnemonic::JA,     "01110111",                  Type::JUMP),
+        encode(Mnemonic::JNP,    "01111011",                  Type::JUMP),
+        encode(Mnemonic::JNO,    "01110001",                  Type::JUMP),
+        encode(Mnemonic::JNS,    "01111001",                  Type::JUMP),
+        encode(Mnemonic::LOOP,   "11100010",                  Type::JUMP),
+        encode(Mnemonic::LOOPZ,  "11100001",                  Type::JUMP),
+        encode(Mnemonic::LOOPNZ, "11100000",                  Type::JUMP),
+        encode(Mnemonic::JCXZ,   "11100011",                  Type::JUMP),
+
+        encode(Mnemonic::PUSH,   "11111111 mod 110 r/m | w=1", Type::RM),
+        encode(Mnemonic::PUSH,   "01010reg",                  Type::REG),
+        encode(Mnemonic::POP,    "10001111 mod 000 r/m | w=1", Type::RM),
+        encode(Mnemonic::POP,    "01011reg",                  Type::REG),
+        encode(Mnemonic::PUSH,   "000sr110",                  Type::SEGMENT),
+        encode(Mnemonic::POP,    "000sr111",                  Type::SEGMENT),
+        encode(Mnemonic::PUSHF,  "10011100",                  Type::NO_OPERANDS),
+        encode(Mnemonic::POPF,   "10011101",                  Type::NO_OPERANDS),
+
+        encode(Mnemonic::CALL,   "11101000",                  Type::JUMP_NEAR),
+        encode(Mnemonic::CALL,   "11111111 mod 010 r/m | w=1", Type::RM),
+        encode(Mnemonic::JMP,    "11101001",                  Type::JUMP_NEAR),
+        encode(Mnemonic::JMP,    "11101011",                  Type::JUMP),
+        encode(Mnemonic::JMP,    "11111111 mod 100 r/m | w=1", Type::RM),
+        encode(Mnemonic::RET,    "11000011",                  Type::NO_OPERANDS),
+        encode(Mnemonic::RET,    "11000010",                  Type::IMM_WORD),
+
+        encode(Mnemonic::INT,    "11001101",                  Type::IMM_BYTE),
+        encode(Mnemonic::INT3,   "11001100",                  Type::NO_OPERANDS),
+        encode(Mnemonic::INTO,   "11001110",                  Type::NO_OPERANDS),
+        encode(Mnemonic::IRET,   "11001111",                  Type::NO_OPERANDS),
+
+        encode(Mnemonic::IN,     "1110010w",                  Type::PORT_FIXED),
+        encode(Mnemonic::IN,     "1110110w",                  Type::PORT_VARIABLE),
+        encode(Mnemonic::OUT,    "1110011w",                  Type::PORT_FIXED),
+        encode(Mnemonic::OUT,    "1110111w",                  Type::PORT_VARIABLE),
+
+        encode(Mnemonic::MOVSB,  "10100100",                  Type::NO_OPERANDS),
+        encode(Mnemonic::MOVSW,  "10100101",                  Type::NO_OPERANDS),
+        encode(Mnemonic::CMPSB,  "10100110",                  Type::NO_OPERANDS),
+        encode(Mnemonic::CMPSW,  "10100111",                  Type::NO_OPERANDS),
+        encode(Mnemonic::SCASB,  "10101110",                  Type::NO_OPERANDS),
+        encode(Mnemonic::SCASW,  "10101111",                  Type::NO_OPERANDS),
+        encode(Mnemonic::LODSB,  "10101100",                  Type::NO_OPERANDS),
+        encode(Mnemonic::LODSW,  "10101101",                  Type::NO_OPERANDS),
+        encode(Mnemonic::STOSB,  "10101010",                  Type::NO_OPERANDS),
+        encode(Mnemonic::STOSW,  "10101011",                  Type::NO_OPERANDS),
+
+        encode(Mnemonic::CLD,    "11111100",                  Type::NO_OPERANDS),
+        encode(Mnemonic::STD,    "11111101",                  Type::NO_OPERANDS),
+        encode(Mnemonic::CLI,    "11111010",                  Type::NO_OPERANDS),
+        encode(Mnemonic::STI,    "11111011",                  Type::NO_OPERANDS),
+        encode(Mnemonic::HLT,    "11110100",                  Type::NO_OPERANDS),
+    });
+    // clang-format on
+
+    [[nodiscard]] constexpr bool overlaps(const MatchCondition &a, const MatchCondition &b) {
+        return !((a.equals ^ b.equals) & a.mask & b.mask);
+    }
+
+    // Whether everything b matches, a matches too
+    [[nodiscard]] constexpr bool covers(const Encoding &a, const Encoding &b) {
+        return (a.first.mask & b.first.mask) == a.first.mask &&
+               (a.second.mask & b.second.mask) == a.second.mask;
+    }
+
+    [[nodiscard]] constexpr int specificity(const Encoding &encoding) {
+        return std::popcount(encoding.first.mask) + std::popcount(encoding.second.mask);
+    }
+
+    // Two encodings may only both match some bytes if one is a special case of the other, like
+    // nop and xchg. Dispatch tries the special case first, so table order never matters.
+    consteval bool unambiguous() {
+        for (std::size_t i = 0; i < ENCODINGS.size(); i++) {
+            for (std::size_t j = i + 1; j < ENCODINGS.size(); j++) {
+                const Encoding &a = ENCODINGS[i];
+                const Encoding &b = ENCODINGS[j];
+                if (!overlaps(a.first, b.first) || !overlaps(a.second, b.second))
+                    continue;
+                if (covers(a, b) == covers(b, a))
+                    return false;
+            }
+        }
+        return true;
+    }
+    static_assert(unambiguous(), "two encodings match the same bytes and neither is more specific");
+
+    consteval std::size_t dispatch_size() {
+        std::size_t size = 0;
+        for (int first = 0; first < 256; first++) {
+            for (const Encoding &encoding : ENCODINGS)
+                size += encoding.first.matches(first);
+        }
+        return size;
+    }
+
+    struct Dispatch {
+        std::array<Encoding, dispatch_size()> encodings;
+        std::array<u16, 257> offsets; // first byte -> its encodings' start, and the end
+    };
+
+    consteval Dispatch build_dispatch() {
+        Dispatch dispatch{};
+        std::size_t size = 0;
+
+        for (int first = 0; first < 256; first++) {
+            dispatch.offsets[first] = size;
+            const std::size_t begin = size;
+
+            for (const Encoding &encoding : ENCODINGS) {
+                if (!encoding.first.matches(first))
+                    continue;
+
+                // insertion sort, most specific first
+                std::size_t at = size++;
+                const int rank = specificity(encoding);
+                while (at > begin && specificity(dispatch.encodings[at - 1]) < rank) {
+                    dispatch.encodings[at] = dispatch.encodings[at - 1];
+                    at--;
+                }
+                dispatch.encodings[at] = encoding;
+            }
+        }
+
+        dispatch.offsets[256] = size;
+        return dispatch;
+    }
+
+    constexpr Dispatch DISPATCH = build_dispatch();
 } // namespace
 
-// clang-format off
-const std::vector<Encoding> instruction_encodings = {
-    {instructions::Mnemonic::MOV,    FIRST(0xFC, 0b100010),  NO_MATCH,            D(0x02), NONE,    W(0x01), MOD(0xC0), REG(0x38), RM(0x07), Encoding::RM_WITH_REG},
-    {instructions::Mnemonic::MOV,    FIRST(0xFE, 0b1100011), NO_MATCH,            NONE,    NONE,    W(0x01), MOD(0xC0), NONE,      RM(0x07), Encoding::IMM_WITH_RM},
-    {instructions::Mnemonic::MOV,    FIRST(0xF0, 0b1011),    NO_MATCH,            NONE,    NONE,    W(0x08), NONE,      REG(0x07), NONE,     Encoding::IMM_TO_REG},
-
-    {instructions::Mnemonic::ADD,    FIRST(0xFC, 0b000000),  NO_MATCH,            D(0x02), NONE,    W(0x01), MOD(0xC0), REG(0x38), RM(0x07), Encoding::RM_WITH_REG},
-    {instructions::Mnemonic::ADD,    FIRST(0xFC, 0b100000),  SECOND(0x38, 0b000), NONE,    S(0x02), W(0x01), MOD(0xC0), REG(0x38), RM(0x07), Encoding::IMM_WITH_RM},
-    {instructions::Mnemonic::ADD,    FIRST(0xFE, 0b0000010), NO_MATCH,            NONE,    NONE,    W(0x01), NONE,      NONE,      NONE,     Encoding::IMM_WITH_ACC},
-
-    {instructions::Mnemonic::SUB,    FIRST(0xFC, 0b001010),  NO_MATCH,            D(0x02), NONE,    W(0x01), MOD(0xC0), REG(0x38), RM(0x07), Encoding::RM_WITH_REG},
-    {instructions::Mnemonic::SUB,    FIRST(0xFC, 0b100000),  SECOND(0x38, 0b101), NONE,    S(0x02), W(0x01), MOD(0xC0), REG(0x38), RM(0x07), Encoding::IMM_WITH_RM},
-    {instructions::Mnemonic::SUB,    FIRST(0xFE, 0b0010110), NO_MATCH,            NONE,    NONE,    W(0x01), NONE,      NONE,      NONE,     Encoding::IMM_WITH_ACC},
-
-    {instructions::Mnemonic::CMP,    FIRST(0xFC, 0b001110),  NO_MATCH,            D(0x02), NONE,    W(0x01), MOD(0xC0), REG(0x38), RM(0x07), Encoding::RM_WITH_REG},
-    {instructions::Mnemonic::CMP,    FIRST(0xFC, 0b100000),  SECOND(0x38, 0b111), NONE,    S(0x02), W(0x01), MOD(0xC0), REG(0x38), RM(0x07), Encoding::IMM_WITH_RM},
-    {instructions::Mnemonic::CMP,    FIRST(0xFE, 0b0011110), NO_MATCH,            NONE,    NONE,    W(0x01), NONE,      NONE,      NONE,     Encoding::IMM_WITH_ACC},
-
-    {instructions::Mnemonic::JE,     FIRST(0xFF, 0x74),      NO_MATCH,            NONE,    NONE,    NONE,    NONE,      NONE,      NONE,     Encoding::JUMP},
-    {instructions::Mnemonic::JL,     FIRST(0xFF, 0x7C),      NO_MATCH,            NONE,    NONE,    NONE,    NONE,      NONE,      NONE,     Encoding::JUMP},
-    {instructions::Mnemonic::JLE,    FIRST(0xFF, 0x7E),      NO_MATCH,            NONE,    NONE,    NONE,    NONE,      NONE,      NONE,     Encoding::JUMP},
-    {instructions::Mnemonic::JB,     FIRST(0xFF, 0x72),      NO_MATCH,            NONE,    NONE,    NONE,    NONE,      NONE,      NONE,     Encoding::JUMP},
-    {instructions::Mnemonic::JBE,    FIRST(0xFF, 0x76),      NO_MATCH,            NONE,    NONE,    NONE,    NONE,      NONE,      NONE,     Encoding::JUMP},
-    {instructions::Mnemonic::JP,     FIRST(0xFF, 0x7A),      NO_MATCH,            NONE,    NONE,    NONE,    NONE,      NONE,      NONE,     Encoding::JUMP},
-    {instructions::Mnemonic::JO,     FIRST(0xFF, 0x70),      NO_MATCH,            NONE,    NONE,    NONE,    NONE,      NONE,      NONE,     Encoding::JUMP},
-    {instructions::Mnemonic::JS,     FIRST(0xFF, 0x78),      NO_MATCH,            NONE,    NONE,    NONE,    NONE,      NONE,      NONE,     Encoding::JUMP},
-    {instructions::Mnemonic::JNE,    FIRST(0xFF, 0x75),      NO_MATCH,            NONE,    NONE,    NONE,    NONE,      NONE,      NONE,     Encoding::JUMP},
-    {instructions::Mnemonic::JNL,    FIRST(0xFF, 0x7D),      NO_MATCH,            NONE,    NONE,    NONE,    NONE,      NONE,      NONE,     Encoding::JUMP},
-    {instructions::Mnemonic::JG,     FIRST(0xFF, 0x7F),      NO_MATCH,            NONE,    NONE,    NONE,    NONE,      NONE,      NONE,     Encoding::JUMP},
-    {instructions::Mnemonic::JNB,    FIRST(0xFF, 0x73),      NO_MATCH,            NONE,    NONE,    NONE,    NONE,      NONE,      NONE,     Encoding::JUMP},
-    {instructions::Mnemonic::JA,     FIRST(0xFF, 0x77),      NO_MATCH,            NONE,    NONE,    NONE,    NONE,      NONE,      NONE,     Encoding::JUMP},
-    {instructions::Mnemonic::JNP,    FIRST(0xFF, 0x7B),      NO_MATCH,            NONE,    NONE,    NONE,    NONE,      NONE,      NONE,     Encoding::JUMP},
-    {instructions::Mnemonic::JNO,    FIRST(0xFF, 0x71),      NO_MATCH,            NONE,    NONE,    NONE,    NONE,      NONE,      NONE,     Encoding::JUMP},
-    {instructions::Mnemonic::JNS,    FIRST(0xFF, 0x79),      NO_MATCH,            NONE,    NONE,    NONE,    NONE,      NONE,      NONE,     Encoding::JUMP},
-    {instructions::Mnemonic::LOOP,   FIRST(0xFF, 0xE2),      NO_MATCH,            NONE,    NONE,    NONE,    NONE,      NONE,      NONE,     Encoding::JUMP},
-    {instructions::Mnemonic::LOOPZ,  FIRST(0xFF, 0xE1),      NO_MATCH,            NONE,    NONE,    NONE,    NONE,      NONE,      NONE,     Encoding::JUMP},
-    {instructions::Mnemonic::LOOPNZ, FIRST(0xFF, 0xE0),      NO_MATCH,            NONE,    NONE,    NONE,    NONE,      NONE,      NONE,     Encoding::JUMP},
-    {instructions::Mnemonic::JCXZ,   FIRST(0xFF, 0xE3),      NO_MATCH,            NONE,    NONE,    NONE,    NONE,      NONE,      NONE,     Encoding::JUMP}
-};
-// clang-format on
+std::span<const Encoding> candidates(u8 first) noexcept {
+    return std::span(DISPATCH.encodings)
+        .subspan(DISPATCH.offsets[first], DISPATCH.offsets[first + 1] - DISPATCH.offsets[first]);
+}
 
 } // namespace sim::decode::table
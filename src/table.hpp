@@ -4,52 +4,39 @@
 
 #include "instructions.hpp"
 
-#include <vector>
+#include <span>
 
-// quite convoluted
+// The instruction table. Encodings are written as bit patterns in table.cpp and turned into
+// per-opcode dispatch at compile time; see the comment there for the pattern syntax.
 
 namespace sim::decode::table {
 
 struct BitField {
-    u8 mask;
-    u8 shift;
+    u8 mask = 0;
+    u8 shift = 0;
+    u8 implied = 0; // what a field that isn't encoded in the instruction reads as
 
-    [[nodiscard]] constexpr u8 read(u8 byte) const noexcept { return (byte & mask) >> shift; }
-
-    [[nodiscard]] static constexpr BitField create(u8 mask) noexcept {
-        u8 shift = 0;
-        u8 temp_mask = mask;
-
-        while (temp_mask && !(temp_mask & 1)) {
-            shift++;
-            temp_mask >>= 1;
-        }
-
-        return BitField{mask, shift};
+    [[nodiscard]] constexpr u8 read(u8 byte) const noexcept {
+        return ((byte & mask) >> shift) | implied;
     }
 };
 
 struct MatchCondition {
-    BitField mask;
-    u8 equals;
-
-    [[nodiscard]] static constexpr MatchCondition create(u8 mask, u8 equals) noexcept {
-        return MatchCondition{BitField::create(mask), equals};
-    }
+    u8 mask = 0;
+    u8 equals = 0;
 
-    // NOTE(louis): this match condition will always evaluate to 'true'
-    [[nodiscard]] static constexpr MatchCondition none() noexcept {
-        return MatchCondition{BitField{0, 0}, 0};
+    [[nodiscard]] constexpr bool matches(u8 byte) const noexcept {
+        return (byte & mask) == equals;
     }
 };
 
 struct Encoding {
-    instructions::Mnemonic mnemonic;
+    instructions::Mnemonic mnemonic{};
 
-    MatchCondition opcode_pattern;
-    MatchCondition reg_pattern;
+    MatchCondition first;
+    MatchCondition second;
 
-    BitField d;
+    BitField d; // also holds the shift's 'v' bit
     BitField s;
     BitField w;
     BitField mod;
@@ -58,24 +45,41 @@ struct Encoding {
 
     enum Type {
         RM_WITH_REG,
+        SEGMENT_WITH_RM, // sr in the reg field, always a word
         IMM_WITH_RM,
         IMM_WITH_ACC,
         IMM_TO_REG,
+        REG,
+        REG_WITH_ACC,
+        SEGMENT, // sr in bits 4-3 of the opcode
+        RM,
+        SHIFT, // d holds the 'v' bit: count in cl rather than 1
         JUMP,
-    } type;
-
-    [[nodiscard]] static constexpr bool matches(const decode::table::Encoding &encoding, u8 first,
-                                                u8 second) {
-        const bool opcode_matches =
-            encoding.opcode_pattern.mask.read(first) == encoding.opcode_pattern.equals;
-
-        const bool reg_matches =
-            encoding.reg_pattern.mask.read(second) == encoding.reg_pattern.equals;
-
-        return opcode_matches && reg_matches;
+        JUMP_NEAR,
+        IMM_BYTE,
+        IMM_WORD,
+        PORT_FIXED,    // port number in an immediate byte
+        PORT_VARIABLE, // port number in dx
+        NO_OPERANDS,
+    } type{};
+
+    // Whether the encoding has a mod reg r/m byte after the opcode
+    [[nodiscard]] static constexpr bool has_modrm(Type type) noexcept {
+        switch (type) {
+        case RM_WITH_REG:
+        case SEGMENT_WITH_RM:
+        case IMM_WITH_RM:
+        case RM:
+        case SHIFT:
+            return true;
+        default:
+            return false;
+        }
     }
 };
 
-extern const std::vector<Encoding> instruction_encodings;
+// Every encoding whose opcode byte can be first, most specific first. They differ only in what
+// they want from the second byte, and the first of them that matches it is the one.
+[[nodiscard]] std::span<const Encoding> candidates(u8 first) noexcept;
 
 } // namespace sim::decode::table
@@ -0,0 +1,213 @@
+#pragma once
+
+#include "common.hpp"
+
+#include "instructions.hpp"
+#include "memory.hpp"
+#include "registers.hpp"
+
+#include <cstdint>
+
+// 8086 clock estimates, from the instruction timing tables in the 8086 family user's manual.
+// Where the manual gives a range (MUL/DIV) the midpoint is used, and the +4 penalty for word
+// transfers at odd addresses is not modelled.
+
+namespace sim::timing {
+
+// Taking an external interrupt, from INTR to the first instruction of the handler
+static constexpr std::uint32_t HARDWARE_INTERRUPT = 61;
+
+// Effective address calculation time, including 2 for a segment override
+[[nodiscard]] constexpr std::uint32_t ea_clocks(const mem::MemoryAccess &access) noexcept {
+    const u8 base = access.terms[0].index;
+    const u8 index = access.terms[1].index;
+    const std::uint32_t prefix = access.is_override ? 2 : 0;
+
+    if (base == registers::NONE)
+        return 6 + prefix;
+
+    const std::uint32_t disp = access.displacement ? 4 : 0;
+    if (index == registers::NONE)
+        return 5 + disp + prefix;
+
+    // bp + di and bx + si are a clock faster than bp + si and bx + di
+    const bool fast = (base == registers::BP) == (index == registers::DI);
+    return (fast ? 7 : 8) + disp + prefix;
+}
+
+[[nodiscard]] constexpr std::uint32_t estimate(const instructions::Instruction &inst, bool taken,
+                                               std::uint32_t repetitions) noexcept {
+    using instructions::Mnemonic;
+    using Type = instructions::Operand::Type;
+
+    const auto &dst = inst.dst;
+    const auto &src = inst.src;
+
+    const bool dst_mem = dst.type == Type::MEMORY;
+    const bool src_mem = src.type == Type::MEMORY;
+    const bool src_imm = src.type == Type::IMMEDIATE;
+    const bool is_acc = dst.type == Type::REGISTER && dst.reg_access.index == registers::AX;
+
+    const std::uint32_t ea = dst_mem   ? ea_clocks(dst.mem_access)
+                             : src_mem ? ea_clocks(src.mem_access)
+                                       : 0;
+
+    switch (inst.mnemonic) {
+    case Mnemonic::MOV:
+        if (dst_mem)
+            return (src_imm ? 10 : 9) + ea;
+        return src_mem ? 8 + ea : src_imm ? 4 : 2;
+
+    case Mnemonic::ADD:
+    case Mnemonic::ADC:
+    case Mnemonic::SUB:
+    case Mnemonic::SBB:
+    case Mnemonic::AND:
+    case Mnemonic::OR:
+    case Mnemonic::XOR:
+        if (dst_mem)
+            return (src_imm ? 17 : 16) + ea;
+        return src_mem ? 9 + ea : src_imm ? 4 : 3;
+
+    case Mnemonic::CMP:
+        if (dst_mem)
+            return (src_imm ? 10 : 9) + ea;
+        return src_mem ? 9 + ea : src_imm ? 4 : 3;
+
+    case Mnemonic::TEST:
+        if (dst_mem)
+            return (src_imm ? 11 : 9) + ea;
+        return src_mem ? 9 + ea : src_imm ? (is_acc ? 4 : 5) : 3;
+
+    case Mnemonic::INC:
+    case Mnemonic::DEC:
+        return dst_mem ? 15 + ea : dst.is_wide() ? 2 : 3;
+
+    case Mnemonic::NEG:
+    case Mnemonic::NOT:
+        return dst_mem ? 16 + ea : 3;
+
+    case Mnemonic::SHL:
+    case Mnemonic::SHR:
+    case Mnemonic::SAR:
+    case Mnemonic::ROL:
+    case Mnemonic::ROR:
+    case Mnemonic::RCL:
+    case Mnemonic::RCR: {
+        // NOTE(louis): the count is only known at run time, callers pass it in as repetitions
+        if (src.type == Type::IMMEDIATE)
+            return dst_mem ? 15 + ea : 2;
+        return (dst_mem ? 20 + ea : 8) + 4 * repetitions;
+    }
+
+    case Mnemonic::MUL:
+        return (dst.is_wide() ? 126 : 74) + (dst_mem ? 6 + ea : 0);
+    case Mnemonic::IMUL:
+        return (dst.is_wide() ? 141 : 89) + (dst_mem ? 6 + ea : 0);
+    case Mnemonic::DIV:
+        return (dst.is_wide() ? 153 : 85) + (dst_mem ? 6 + ea : 0);
+    case Mnemonic::IDIV:
+        return (dst.is_wide() ? 175 : 107) + (dst_mem ? 6 + ea : 0);
+
+    case Mnemonic::XCHG:
+        if (dst_mem || src_mem)
+            return 17 + ea;
+        return is_acc ? 3 : 4;
+
+    case Mnemonic::LEA:
+        return 2 + ea;
+    case Mnemonic::CBW:
+        return 2;
+    case Mnemonic::CWD:
+        return 5;
+    case Mnemonic::NOP:
+        return 3;
+
+    case Mnemonic::CLC:
+    case Mnemonic::STC:
+    case Mnemonic::CMC:
+    case Mnemonic::CLD:
+    case Mnemonic::STD:
+    case Mnemonic::CLI:
+    case Mnemonic::STI:
+    case Mnemonic::HLT:
+        return 2;
+
+    case Mnemonic::PUSH:
+        return dst_mem ? 16 + ea : dst.type == Type::SEGMENT ? 10 : 11;
+    case Mnemonic::POP:
+        return dst_mem ? 17 + ea : 8;
+    case Mnemonic::PUSHF:
+        return 10;
+    case Mnemonic::POPF:
+        return 8;
+
+    case Mnemonic::CALL:
+        return dst_mem ? 21 + ea : dst.type == Type::REGISTER ? 16 : 19;
+    case Mnemonic::RET:
+        return dst.type == Type::IMMEDIATE ? 12 : 8;
+    case Mnemonic::JMP:
+        return dst_mem ? 18 + ea : dst.type == Type::REGISTER ? 11 : 15;
+
+    case Mnemonic::JE:
+    case Mnemonic::JL:
+    case Mnemonic::JLE:
+    case Mnemonic::JB:
+    case Mnemonic::JBE:
+    case Mnemonic::JP:
+    case Mnemonic::JO:
+    case Mnemonic::JS:
+    case Mnemonic::JNE:
+    case Mnemonic::JNL:
+    case Mnemonic::JG:
+    case Mnemonic::JNB:
+    case Mnemonic::JA:
+    case Mnemonic::JNP:
+    case Mnemonic::JNO:
+    case Mnemonic::JNS:
+        return taken ? 16 : 4;
+
+    case Mnemonic::LOOP:
+        return taken ? 17 : 5;
+    case Mnemonic::LOOPZ:
+        return taken ? 18 : 6;
+    case Mnemonic::LOOPNZ:
+        return taken ? 19 : 5;
+    case Mnemonic::JCXZ:
+        return taken ? 18 : 6;
+
+    case Mnemonic::INT:
+        return 51;
+    case Mnemonic::INT3:
+        return 52;
+    case Mnemonic::INTO:
+        return taken ? 53 : 4;
+    case Mnemonic::IRET:
+        return 24;
+
+    case Mnemonic::IN:
+    case Mnemonic::OUT:
+        return inst.dst.type == Type::IMMEDIATE || inst.src.type == Type::IMMEDIATE ? 10 : 8;
+
+    // REP forms cost 9 to set up plus the per-element time
+    case Mnemonic::MOVSB:
+    case Mnemonic::MOVSW:
+        return inst.prefix == instructions::Prefix::NONE ? 18 : 9 + 17 * repetitions;
+    case Mnemonic::CMPSB:
+    case Mnemonic::CMPSW:
+        return inst.prefix == instructions::Prefix::NONE ? 22 : 9 + 22 * repetitions;
+    case Mnemonic::SCASB:
+    case Mnemonic::SCASW:
+        return inst.prefix == instructions::Prefix::NONE ? 15 : 9 + 15 * repetitions;
+    case Mnemonic::LODSB:
+    case Mnemonic::LODSW:
+        return inst.prefix == instructions::Prefix::NONE ? 12 : 9 + 13 * repetitions;
+    case Mnemonic::STOSB:
+    case Mnemonic::STOSW:
+        return inst.prefix == instructions::Prefix::NONE ? 11 : 9 + 10 * repetitions;
+    }
+
+    return 0;
+}
+
+} // namespace sim::timing
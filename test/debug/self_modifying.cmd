@@ -0,0 +1,10 @@
+# the block at 0x05 is cached by the first pass and patched before the second, which jumps out of
+# it early; continue has to notice it left the block and stop at the breakpoint it lands on
+break 0x10
+c
+x 0x5 5
+d 1
+break 0x1a
+c
+regs
+c
@@ -0,0 +1,16 @@
+# conditional breakpoint inside the recursion, plain one on the interrupt handler
+break 0x27 if cx == 1
+b 0x31
+info
+c
+regs
+p cx
+p zf
+c
+s 2
+d 2
+break if bx != 10
+break 0x1e if dx == 7
+c
+x 0x3f8 8
+c
@@ -0,0 +1,491 @@
+// Fuzz target for the decoder and runner.
+//
+// Built with -fsanitize=fuzzer this is a plain libFuzzer target. Built with
+// -DSIM_FUZZ_STANDALONE it carries its own driver instead:
+//
+//   fuzz_decode [-n iterations] [-seed n] [-max_len n] [-ndisasm]   random inputs
+//   fuzz_decode [-ndisasm] file...                                   replay inputs (AFL: @@)
+//
+// Every input is decoded at each offset and then executed twice in lockstep: once a step at a
+// time and once by run_until after analyse(), which fuses compare-and-branch runs and defers
+// flags, stopping at random instruction, cycle and ip limits. A device raises int 20h every so
+// often while IF is set. Both have to agree on registers, flags, ip and counts at every stop and
+// on memory at the end. Random inputs alternate between raw bytes and programs strung together
+// from loops that fuse, instructions that read or write flags and interrupt handlers. With
+// -ndisasm, the linear decode of each input is also diffed against ndisasm when it's on PATH.
+
+#include "common.hpp"
+
+#include "decode.hpp"
+#include "image.hpp"
+#include "instructions.hpp"
+#include "io.hpp"
+#include "runner.hpp"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <optional>
+#include <utility>
+#include <vector>
+
+namespace {
+constexpr std::size_t MAX_STEPS = 4096;
+constexpr std::size_t MAX_STOPS = 256;
+
+std::uint64_t decoded_instructions = 0;
+
+// Raises int 20h on the first instruction boundary past every PERIOD cycles. A hlt still ends
+// the run: step() would sleep straight through a cycle limit that run_until stops at.
+class Ticker final : public sim::io::Device {
+public:
+    [[nodiscard]] u16 in(u16 port, bool, sim::io::Time now) noexcept override {
+        return static_cast<u16>(port ^ now.instructions);
+    }
+    void out(u16, u16, bool, sim::io::Time) noexcept override {}
+
+    [[nodiscard]] std::optional<u8> interrupt(sim::io::Time now) noexcept override {
+        if (now.cycles < due)
+            return std::nullopt;
+        due = now.cycles + PERIOD;
+        return 0x20;
+    }
+
+private:
+    static constexpr std::uint64_t PERIOD = 97;
+    std::uint64_t due = PERIOD;
+};
+
+// What run_until would have returned, by stepping
+sim::runner::StopReason step_until(sim::runner::Runner &runner,
+                                   const sim::runner::Limits &limits) {
+    using sim::runner::StopReason;
+
+    for (;;) {
+        if (runner.halted())
+            return StopReason::HALTED;
+        if (limits.ip && runner.get_ip() == *limits.ip)
+            return StopReason::IP;
+        if (limits.cycles && runner.get_cycles() >= *limits.cycles)
+            return StopReason::CYCLES;
+        if (limits.instructions && runner.get_instructions() >= *limits.instructions)
+            return StopReason::INSTRUCTIONS;
+
+        if (!runner.step())
+            return runner.left_code_segment() ? StopReason::CODE_SEGMENT
+                                              : StopReason::DECODE_ERROR;
+    }
+}
+
+void expect_same(const sim::runner::Runner &stepped, const sim::runner::Runner &ran) {
+    const auto &a = stepped.get_registers();
+    const auto &b = ran.get_registers();
+
+    bool same = stepped.get_ip() == ran.get_ip() &&
+                stepped.get_instructions() == ran.get_instructions() &&
+                stepped.get_cycles() == ran.get_cycles() &&
+                stepped.get_flags().word() == ran.get_flags().word();
+    for (u8 i = 0; i < sim::registers::REG_NAMES.size(); i++)
+        same = same && a.read({i, true}) == b.read({i, true});
+    for (u8 i = 0; i < sim::registers::SEGMENT_NAMES.size(); i++)
+        same = same && a.read_segment(i) == b.read_segment(i);
+
+    if (!same) {
+        std::fprintf(stderr, "run_until and step disagree at instruction %llu\n",
+                     static_cast<unsigned long long>(stepped.get_instructions()));
+        std::abort();
+    }
+}
+
+// Runs memory both ways, stopping wherever the bytes of the input say
+void check_run_until(const std::vector<u8> &memory) {
+    auto stepped_memory = sim::image::GuestMemory::copy_of(memory);
+    auto ran_memory = sim::image::GuestMemory::copy_of(memory);
+    if (!stepped_memory || !ran_memory)
+        return;
+
+    sim::runner::Runner stepped(std::move(*stepped_memory));
+    sim::runner::Runner ran(std::move(*ran_memory));
+    Ticker stepped_device, ran_device;
+    stepped.attach_device(stepped_device);
+    ran.attach_device(ran_device);
+    // NOTE(louis): flags are only deferred once there's a graph to say nothing reads them
+    ran.analyse();
+
+    // NOTE(louis): seeded from the input, so a crash replays from the file alone
+    std::uint64_t state = memory.size();
+    for (const u8 byte : memory)
+        state = state * 0x100000001B3 ^ byte;
+    auto next = [&state](std::uint64_t bound) {
+        state = state * 6364136223846793005 + 1442695040888963407;
+        return (state >> 33) % bound;
+    };
+
+    for (std::size_t i = 0; i < MAX_STOPS && stepped.get_instructions() < MAX_STEPS; i++) {
+        // always bounded by a count, since an ip limit may never come round
+        sim::runner::Limits limits;
+        limits.instructions = stepped.get_instructions() + 1 + next(64);
+        switch (next(3)) {
+        case 0:
+            break;
+        case 1:
+            limits.cycles = stepped.get_cycles() + 1 + next(512);
+            break;
+        case 2:
+            limits.ip = static_cast<u16>(next(std::max<std::size_t>(memory.size(), 1)));
+            break;
+        }
+
+        const auto expected = step_until(stepped, limits);
+        const auto result = ran.run_until(limits);
+        if (result.reason != expected) {
+            std::fprintf(stderr, "run_until stopped on %d, stepping on %d\n",
+                         static_cast<int>(result.reason), static_cast<int>(expected));
+            std::abort();
+        }
+        expect_same(stepped, ran);
+
+        if (expected == sim::runner::StopReason::HALTED ||
+            expected == sim::runner::StopReason::DECODE_ERROR ||
+            expected == sim::runner::StopReason::CODE_SEGMENT)
+            break;
+    }
+
+    const auto a = stepped.get_memory();
+    const auto b = ran.get_memory();
+    if (!std::equal(a.begin(), a.end(), b.begin(), b.end())) {
+        std::fprintf(stderr, "run_until and step disagree on memory\n");
+        std::abort();
+    }
+}
+
+void fuzz_one(const std::vector<u8> &memory) {
+    // NOTE(louis): decoding from every offset, not just instruction boundaries, reaches the
+    // truncated encodings at the end of the buffer
+    for (std::size_t address = 0; address < memory.size() && address <= 0xFFFF; address++) {
+        const auto inst = sim::decode::try_decode(memory, address);
+        if (!inst)
+            continue;
+
+        decoded_instructions++;
+
+        // rep/repne and segment overrides, any number of them
+        auto is_prefix = [](u8 byte) {
+            return byte == 0xF2 || byte == 0xF3 || (byte & 0xE7) == 0x26;
+        };
+
+        std::size_t prefixes = 0;
+        while (prefixes < inst->bytes.size() && is_prefix(inst->bytes[prefixes]))
+            prefixes++;
+
+        if (inst->bytes.size() == prefixes || inst->bytes.size() - prefixes > 6 ||
+            address + inst->bytes.size() > memory.size()) {
+            std::abort();
+        }
+
+        for (std::size_t i = 0; i < inst->bytes.size(); i++) {
+            if (inst->bytes[i] != memory[address + i])
+                std::abort();
+        }
+
+        (void)sim::instructions::Instruction::string(*inst);
+    }
+
+    check_run_until(memory);
+}
+} // namespace
+
+extern "C" int LLVMFuzzerTestOneInput(const std::uint8_t *data, std::size_t size) {
+    fuzz_one(std::vector<u8>(data, data + size));
+    return 0;
+}
+
+#ifdef SIM_FUZZ_STANDALONE
+
+#include <array>
+#include <chrono>
+#include <fstream>
+#include <initializer_list>
+#include <iostream>
+#include <iterator>
+#include <random>
+#include <sstream>
+#include <string>
+#include <string_view>
+#include <unistd.h>
+
+namespace {
+struct Disassembly {
+    std::size_t length;
+    std::string mnemonic;
+};
+
+// ndisasm spells a few conditions differently
+std::string_view canonical(std::string_view mnemonic) {
+    static constexpr std::array<std::pair<std::string_view, std::string_view>, 10> ALIASES = {{
+        {"je", "jz"},
+        {"jne", "jnz"},
+        {"jb", "jc"},
+        {"jnb", "jnc"},
+        {"jbe", "jna"},
+        {"jp", "jpe"},
+        {"jnp", "jpo"},
+        {"jle", "jng"},
+        {"loopz", "loope"},
+        {"loopnz", "loopne"},
+    }};
+
+    for (const auto &[ours, theirs] : ALIASES) {
+        if (mnemonic == ours)
+            return theirs;
+    }
+    return mnemonic;
+}
+
+bool has_ndisasm() { return std::system("command -v ndisasm >/dev/null 2>&1") == 0; }
+
+std::vector<Disassembly> ndisasm(const std::vector<u8> &memory) {
+    char path[] = "/tmp/fuzz_decode.XXXXXX";
+    const int fd = mkstemp(path);
+    if (fd < 0)
+        return {};
+
+    (void)!write(fd, memory.data(), memory.size());
+    close(fd);
+
+    std::vector<Disassembly> result;
+    const std::string command = std::string("ndisasm -b16 ") + path;
+
+    if (FILE *pipe = popen(command.c_str(), "r")) {
+        // "00000000  89D9              mov cx,bx"
+        char line[256];
+        while (std::fgets(line, sizeof(line), pipe)) {
+            std::istringstream ss(line);
+            std::string offset, hex, mnemonic;
+            ss >> offset >> hex >> mnemonic;
+
+            // continuation lines for long instructions start with '-'
+            if (!hex.empty() && hex[0] == '-') {
+                result.back().length += hex.size() / 2 - 1;
+                continue;
+            }
+
+            if (mnemonic == "rep" || mnemonic == "repe" || mnemonic == "repne")
+                ss >> mnemonic;
+
+            result.push_back(Disassembly{hex.size() / 2, mnemonic});
+        }
+        pclose(pipe);
+    }
+
+    unlink(path);
+    return result;
+}
+
+// Returns the number of instructions that disagree with ndisasm, up to the first one we can't
+// decode. Anything we don't implement yet just ends the comparison.
+std::size_t diff_against_ndisasm(const std::vector<u8> &memory) {
+    const auto reference = ndisasm(memory);
+
+    std::size_t address = 0;
+    for (const auto &expected : reference) {
+        const auto inst = sim::decode::try_decode(memory, address);
+        if (!inst)
+            break;
+
+        const auto ours = canonical(sim::instructions::MNEMONIC_NAMES[inst->mnemonic]);
+        if (inst->bytes.size() != expected.length || ours != expected.mnemonic) {
+            std::cerr << "mismatch at 0x" << std::hex << address << std::dec << ": "
+                      << sim::instructions::Instruction::string(*inst) << " vs ndisasm '"
+                      << expected.mnemonic << "' (" << expected.length << " bytes)\n";
+            return 1;
+        }
+
+        address += inst->bytes.size();
+    }
+
+    return 0;
+}
+
+// Strings together counted loops in the shapes that fuse (dec/jnz, add/cmp/jcc, cmp/jcc), stores
+// into the program itself, instructions that read or write flags, int 20h handlers and raw bytes,
+// so random inputs reach run_until's fused path and every place deferred flags have to settle
+std::vector<u8> program(std::mt19937_64 &rng, std::size_t max_len) {
+    static constexpr std::array<std::array<u8, 2>, 6> BODIES = {{
+        {0x40, 0x90}, // inc ax; nop
+        {0x43, 0x90}, // inc bx; nop
+        {0x01, 0xD8}, // add ax, bx
+        {0x29, 0xC3}, // sub bx, ax
+        {0x31, 0xD2}, // xor dx, dx
+        {0x88, 0x07}, // mov [bx], al
+    }};
+    static constexpr std::array<std::array<u8, 2>, 14> FLAGS = {{
+        {0xF8, 0x90}, // clc; nop
+        {0xF9, 0x90}, // stc; nop
+        {0xF5, 0x90}, // cmc; nop
+        {0x9C, 0x90}, // pushf; nop
+        {0x9D, 0x90}, // popf; nop
+        {0x9C, 0x9D}, // pushf; popf
+        {0x9E, 0x9F}, // sahf; lahf
+        {0xFB, 0x90}, // sti; nop
+        {0xFA, 0x90}, // cli; nop
+        {0x13, 0xC3}, // adc ax, bx
+        {0x1B, 0xC3}, // sbb ax, bx
+        {0xF6, 0xF3}, // div bl
+        {0xCD, 0x20}, // int 20h
+        {0x72, 0x00}, // jc $+2
+    }};
+
+    std::vector<u8> memory;
+    auto emit = [&memory](std::initializer_list<u8> bytes) {
+        memory.insert(memory.end(), bytes);
+    };
+    auto body = [&] {
+        for (auto n = rng() % 3; n; n--) {
+            const auto &inst =
+                rng() % 2 ? BODIES[rng() % BODIES.size()] : FLAGS[rng() % FLAGS.size()];
+            emit({inst[0], inst[1]});
+        }
+    };
+    auto back_to = [&memory](std::size_t top) {
+        return static_cast<u8>(top - (memory.size() + 1));
+    };
+
+    while (memory.size() < max_len) {
+        const std::size_t top = memory.size();
+        switch (rng() % 7) {
+        case 0: // mov cx, n; top: ...; dec cx; jnz top
+            emit({0xB9, static_cast<u8>(rng() % 32), 0x00});
+            body();
+            emit({0x49, 0x75});
+            memory.push_back(back_to(top + 3));
+            break;
+        case 1: // mov bx, n; mov ax, 0; top: ...; add ax, 1; cmp ax, bx; jl top
+            emit({0xBB, static_cast<u8>(rng() % 32), 0x00, 0xB8, 0x00, 0x00});
+            body();
+            emit({0x83, 0xC0, 0x01, 0x39, 0xD8, 0x7C});
+            memory.push_back(back_to(top + 6));
+            break;
+        case 2: // cmp ax, imm; jcc anywhere close
+            emit({0x3D, static_cast<u8>(rng()), static_cast<u8>(rng() % 2),
+                  static_cast<u8>(0x70 + rng() % 16), static_cast<u8>(rng() % 16 - 12)});
+            break;
+        case 3: // add byte [addr], imm somewhere in the program
+            emit({0x80, 0x06, static_cast<u8>(rng() % (max_len + 1)), 0x00,
+                  static_cast<u8>(rng())});
+            break;
+        case 4:
+            for (auto n = 1 + rng() % 4; n; n--)
+                memory.push_back(static_cast<u8>(rng()));
+            break;
+        case 5: {
+            const auto &inst = FLAGS[rng() % FLAGS.size()];
+            emit({inst[0], inst[1]});
+            break;
+        }
+        case 6: { // mov word [80h], handler; jmp over; handler: ...; iret; over:
+            const std::size_t handler = top + 8;
+            emit({0xC7, 0x06, 0x80, 0x00, static_cast<u8>(handler), static_cast<u8>(handler >> 8),
+                  0xEB, 0x00});
+            body();
+            memory.push_back(0xCF);
+            memory[handler - 1] = static_cast<u8>(memory.size() - handler);
+            break;
+        }
+        }
+    }
+
+    memory.resize(max_len);
+    return memory;
+}
+
+void report(std::uint64_t execs, std::chrono::steady_clock::time_point start) {
+    const double seconds =
+        std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    std::cerr << "execs: " << execs << "  execs/s: " << static_cast<std::uint64_t>(execs / seconds)
+              << "  decoded/s: " << static_cast<std::uint64_t>(decoded_instructions / seconds)
+              << "\n";
+}
+} // namespace
+
+int main(int argc, char *argv[]) {
+    std::uint64_t iterations = 100000;
+    std::uint64_t seed = std::random_device{}();
+    std::size_t max_len = 64;
+    bool differential = false;
+    std::vector<std::string> files;
+
+    for (int i = 1; i < argc; i++) {
+        const std::string_view arg = argv[i];
+
+        if (arg == "-n" && i + 1 < argc) {
+            iterations = std::strtoull(argv[++i], nullptr, 10);
+        } else if (arg == "-seed" && i + 1 < argc) {
+            seed = std::strtoull(argv[++i], nullptr, 10);
+        } else if (arg == "-max_len" && i + 1 < argc) {
+            max_len = std::strtoull(argv[++i], nullptr, 10);
+        } else if (arg == "-ndisasm") {
+            differential = true;
+        } else {
+            files.emplace_back(arg);
+        }
+    }
+
+    if (differential && !has_ndisasm()) {
+        std::cerr << "ndisasm not found, skipping the differential check\n";
+        differential = false;
+    }
+
+    std::size_t mismatches = 0;
+    const auto start = std::chrono::steady_clock::now();
+
+    if (!files.empty()) {
+        for (const auto &file : files) {
+            std::ifstream in(file, std::ios::binary);
+            std::vector<u8> memory((std::istreambuf_iterator<char>(in)),
+                                   std::istreambuf_iterator<char>());
+
+            fuzz_one(memory);
+            if (differential)
+                mismatches += diff_against_ndisasm(memory);
+        }
+
+        report(files.size(), start);
+        return mismatches ? 1 : 0;
+    }
+
+    std::cerr << "seed: " << seed << "\n";
+
+    std::mt19937_64 rng(seed);
+    std::vector<u8> memory;
+
+    auto last_report = start;
+    for (std::uint64_t i = 0; i < iterations; i++) {
+        if (i % 2) {
+            memory = program(rng, rng() % (max_len + 1));
+        } else {
+            memory.resize(rng() % (max_len + 1));
+            for (auto &byte : memory)
+                byte = static_cast<u8>(rng());
+        }
+
+        fuzz_one(memory);
+        if (differential)
+            mismatches += diff_against_ndisasm(memory);
+
+        if (std::chrono::steady_clock::now() - last_report > std::chrono::seconds(5)) {
+            report(i + 1, start);
+            last_report = std::chrono::steady_clock::now();
+        }
+    }
+
+    report(iterations, start);
+    if (mismatches)
+        std::cerr << mismatches << " inputs disagreed with ndisasm\n";
+
+    return mismatches ? 1 : 0;
+}
+
+#endif
@@ -0,0 +1,200 @@
+#!/usr/bin/env bash
+# Golden-output regression runner for test/decode, test/simulate, test/debug, test/cfg, test/stats,
+# test/screen and test/sweep.
+#
+#   test/run_tests.sh [--update] [--baseline FILE] [--save-baseline FILE] [listing...]
+#
+# Every listing runs in parallel. Decode listings are disassembled with --decode and compared
+# against <listing>.txt. Simulate listings are executed, replaying <listing>.replay as their port
+# and interrupt input when there is one, and the trace is compared against <listing>.txt. Debug
+# scripts (test/debug/<name>.cmd) drive --debug over test/simulate/<name> and the transcript is
+# compared against <name>.txt. Graphs (test/cfg/<name>.dot) are --cfg over test/simulate/<name>,
+# compared against the .dot itself, stats (test/stats/<name>.json) are the --stats report of
+# running test/simulate/<name>, and screens (test/screen/<name>.screen) are the text display it
+# leaves behind, the last 25 lines of --screen. Sweeps (test/sweep/<name>.args) run
+# test/simulate/<name> with the --sweep options in the file, and the per-run lines are compared
+# against <name>.txt. When nasm is on PATH, every disassembly is also reassembled and compared
+# byte-for-byte against the original binary.
+#
+# Each listing's wall time and instructions/s are reported. With --baseline, a listing fails
+# if its rate drops below baseline / SIM_TEST_SLOWDOWN (default 3).
+
+set -uo pipefail
+
+ROOT=$(cd "$(dirname "$0")/.." && pwd)
+SIM=${SIM:-$ROOT/8086}
+TIMEOUT=${SIM_TEST_TIMEOUT:-10}
+SLOWDOWN=${SIM_TEST_SLOWDOWN:-3}
+JOBS=${SIM_TEST_JOBS:-$(nproc 2>/dev/null || echo 4)}
+
+update=0
+baseline=
+save_baseline=
+listings=()
+
+while [ $# -gt 0 ]; do
+    case $1 in
+    --update) update=1 ;;
+    --baseline) baseline=$2; shift ;;
+    --save-baseline) save_baseline=$2; shift ;;
+    *) listings+=("$1") ;;
+    esac
+    shift
+done
+
+if [ ${#listings[@]} -eq 0 ]; then
+    for f in "$ROOT"/test/decode/* "$ROOT"/test/simulate/* "$ROOT"/test/debug/*.cmd \
+        "$ROOT"/test/cfg/*.dot "$ROOT"/test/stats/*.json "$ROOT"/test/screen/*.screen \
+        "$ROOT"/test/sweep/*.args; do
+        case $f in *.asm | *.txt | *.replay) continue ;; esac
+        [ -f "$f" ] && listings+=("$f")
+    done
+fi
+
+has_nasm=0
+command -v nasm >/dev/null 2>&1 && has_nasm=1
+
+# Runs one listing and prints "name<TAB>status<TAB>ms<TAB>instructions<TAB>detail"
+run_one() {
+    local listing=$1
+    local name=${listing#"$ROOT"/test/}
+    local golden=$listing.txt
+    local binary=$listing
+    local tmp
+    tmp=$(mktemp -d)
+
+    local kind=simulate
+    case $listing in
+    *test/decode/*) kind=decode ;;
+    *test/debug/*.cmd)
+        kind=debug
+        golden=${listing%.cmd}.txt
+        binary=$ROOT/test/simulate/$(basename "$listing" .cmd)
+        ;;
+    *test/cfg/*.dot)
+        kind=cfg
+        golden=$listing
+        binary=$ROOT/test/simulate/$(basename "$listing" .dot)
+        ;;
+    *test/stats/*.json)
+        kind=stats
+        golden=$listing
+        binary=$ROOT/test/simulate/$(basename "$listing" .json)
+        ;;
+    *test/screen/*.screen)
+        kind=screen
+        golden=$listing
+        binary=$ROOT/test/simulate/$(basename "$listing" .screen)
+        ;;
+    *test/sweep/*.args)
+        kind=sweep
+        golden=${listing%.args}.txt
+        binary=$ROOT/test/simulate/$(basename "$listing" .args)
+        ;;
+    esac
+
+    local start end status=ok detail= instructions
+    start=$(date +%s%N)
+    if [ "$kind" = decode ]; then
+        timeout "$TIMEOUT" "$SIM" --decode "$listing" >"$tmp/out" 2>&1
+    elif [ "$kind" = debug ]; then
+        timeout "$TIMEOUT" "$SIM" --script "$listing" "$binary" >"$tmp/out" 2>&1
+    elif [ "$kind" = cfg ]; then
+        timeout "$TIMEOUT" "$SIM" --cfg "$binary" >"$tmp/out" 2>&1
+    elif [ "$kind" = stats ]; then
+        timeout "$TIMEOUT" "$SIM" --stats "$tmp/out" "$binary" >/dev/null 2>&1
+        # NOTE(louis): the report names the image, which shouldn't depend on where ROOT is
+        sed -i "s|\"$ROOT/test/|\"|" "$tmp/out"
+    elif [ "$kind" = screen ]; then
+        timeout "$TIMEOUT" "$SIM" --screen "$binary" 2>&1 | tail -n 25 >"$tmp/out"
+    elif [ "$kind" = sweep ]; then
+        # NOTE(louis): stderr has the wall time, only the runs themselves are deterministic
+        local options
+        read -ra options <"$listing"
+        timeout "$TIMEOUT" "$SIM" "${options[@]}" "$binary" >"$tmp/out" 2>/dev/null
+    else
+        local replay=()
+        [ -f "$listing.replay" ] && replay=(--replay "$listing.replay")
+        timeout "$TIMEOUT" "$SIM" "${replay[@]}" "$listing" >"$tmp/out" 2>&1
+    fi
+    local rc=$?
+    end=$(date +%s%N)
+
+    if [ "$kind" = decode ]; then
+        instructions=$(grep -cvE '^(bits 16|db .*|)$' "$tmp/out")
+    elif [ "$kind" = debug ] || [ "$kind" = cfg ] || [ "$kind" = stats ] ||
+        [ "$kind" = screen ] || [ "$kind" = sweep ]; then
+        instructions=0
+    else
+        instructions=$(grep -cE '^[0-9a-f]{4} ' "$tmp/out")
+    fi
+
+    if [ $rc -eq 124 ]; then
+        status=FAIL detail="timed out after ${TIMEOUT}s"
+    elif [ "$UPDATE" = 1 ]; then
+        cp "$tmp/out" "$golden"
+        status=updated
+    elif [ ! -f "$golden" ]; then
+        status=FAIL detail="no golden output, run with --update"
+    elif ! diff -u "$golden" "$tmp/out" >"$tmp/diff"; then
+        status=FAIL detail="output differs from $(basename "$golden"):\n$(head -20 "$tmp/diff")"
+    fi
+
+    # NOTE(louis): the reassembly check always uses --decode, simulate listings included
+    if [ "$status" != FAIL ] && [ "$HAS_NASM" = 1 ] &&
+        { [ "$kind" = decode ] || [ "$kind" = simulate ]; }; then
+        "$SIM" --decode "$listing" >"$tmp/reasm.asm" 2>/dev/null
+        if ! nasm -f bin -o "$tmp/reasm" "$tmp/reasm.asm" 2>"$tmp/nasm"; then
+            status=FAIL detail="nasm rejected the disassembly:\n$(head -5 "$tmp/nasm")"
+        elif ! cmp -s "$tmp/reasm" "$listing"; then
+            status=FAIL
+            detail="reassembled bytes differ:\n$(cmp -l "$tmp/reasm" "$listing" | head -5)"
+        fi
+    fi
+
+    printf '%s\t%s\t%d\t%d\t%b\n' "$name" "$status" $(((end - start) / 1000000)) "$instructions" \
+        "$detail" | tr '\n' '\037' | sed 's/\x1f$/\n/'
+    rm -rf "$tmp"
+}
+
+export -f run_one
+export ROOT SIM TIMEOUT
+export UPDATE=$update HAS_NASM=$has_nasm
+
+[ -x "$SIM" ] || { echo "missing $SIM, run make first" >&2; exit 1; }
+[ $has_nasm = 1 ] || echo "nasm not found, skipping the reassembly check" >&2
+
+results=$(printf '%s\0' "${listings[@]}" | xargs -0 -n1 -P "$JOBS" bash -c 'run_one "$1"' _ | sort)
+
+failures=0
+rates=
+printf '%-44s %8s %10s %12s\n' listing ms instrs instrs/s
+while IFS=$'\t' read -r name status ms instructions detail; do
+    rate=0
+    [ "$ms" -gt 0 ] && rate=$((instructions * 1000 / ms))
+
+    if [ -n "$baseline" ] && [ -f "$baseline" ] && [ "$status" != FAIL ]; then
+        expected=$(awk -F'\t' -v n="$name" '$1 == n { print $2 }' "$baseline")
+        if [ -n "$expected" ] && [ $((rate * SLOWDOWN)) -lt "$expected" ]; then
+            status=FAIL
+            detail="$rate instrs/s is more than ${SLOWDOWN}x below the baseline $expected"
+        fi
+    fi
+
+    printf '%-44s %8d %10d %12d  %s\n' "$name" "$ms" "$instructions" "$rate" "$status"
+    if [ "$status" = FAIL ]; then
+        failures=$((failures + 1))
+        printf '    %s\n' "${detail//$'\037'/$'\n'    }"
+    fi
+
+    rates+="$name"$'\t'"$rate"$'\n'
+done <<<"$results"
+
+[ -n "$save_baseline" ] && printf '%s' "$rates" >"$save_baseline"
+
+echo
+if [ $failures -gt 0 ]; then
+    echo "$failures of ${#listings[@]} listings failed"
+    exit 1
+fi
+echo "all ${#listings[@]} listings passed"
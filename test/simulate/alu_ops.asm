@@ -0,0 +1,50 @@
+bits 16
+
+mov ax, 0x1234
+mov bx, 0x00FF
+and ax, bx
+or ax, 0x0F00
+xor bx, bx
+test ax, 0x8000
+not ax
+neg ax
+inc bx
+dec bx
+
+mov cl, 4
+shl ax, cl
+shr ax, 1
+sar ax, cl
+rol ax, 1
+ror ax, cl
+stc
+rcl ax, 1
+rcr ax, 1
+
+mov bx, 300
+mul bx
+div bx
+mov ax, -7
+cwd
+mov bx, 2
+idiv bx
+imul bx
+mov al, 0x80
+cbw
+xchg ax, bx
+lea si, [bx + di + 8]
+
+cmp ax, bx
+jg skip_signed
+mov di, 1
+skip_signed:
+jb skip_unsigned
+mov di, 2
+skip_unsigned:
+
+mov cx, 3
+loop_start:
+	add dx, 1
+	loop loop_start
+adc dx, 0
+sbb dx, 1
@@ -0,0 +1,12 @@
+; code only runs from segment 0, so an int through a vector whose segment half isn't 0 stops the
+; run on the int, before it pushes anything
+bits 16
+
+mov sp, 1024
+mov word [0x84], handler
+int 0x21
+mov word [0x86], 0x1000
+int 0x21
+
+handler:
+	iret
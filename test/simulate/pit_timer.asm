@@ -0,0 +1,41 @@
+; the PIC moved to vector 0x20, the PIT's channel 0 interrupting every 40 ticks (160 cycles)
+bits 16
+
+mov sp, 1024
+mov word [128], handler
+mov al, 0x13
+out 0x20, al
+mov al, 0x20
+out 0x21, al
+mov al, 0x01
+out 0x21, al
+mov al, 0x34
+out 0x43, al
+mov al, 40
+out 0x40, al
+mov al, 0
+out 0x40, al
+sti
+
+wait:
+hlt
+cmp bx, 3
+jne wait
+
+mov al, 0xff
+out 0x21, al
+mov al, 0
+out 0x43, al
+in al, 0x40
+mov cl, al
+in al, 0x40
+mov ch, al
+jmp done
+
+handler:
+	inc bx
+	mov al, 0x20
+	out 0x20, al
+	iret
+
+done:
@@ -0,0 +1,23 @@
+; run with --replay port_io.replay, which supplies the port reads and raises int 0x20 once it halts
+bits 16
+
+mov sp, 1024
+mov word [128], handler
+sti
+in al, 0x60
+mov bl, al
+mov dx, 0x3da
+in ax, dx
+mov cx, ax
+out 0x20, al
+out dx, ax
+hlt
+nop
+jmp done
+
+handler:
+	in al, 0x61
+	mov si, ax
+	iret
+
+done:
@@ -0,0 +1,22 @@
+; text written to the CGA buffer at B800:0000 through es and ds, by plain and string moves,
+; checked against test/screen/screen_text.screen
+bits 16
+
+mov ax, 0xb800
+mov es, ax
+mov word [es:0], 0x0748
+mov word [es:2], 0x0769
+
+mov ds, ax
+mov byte [160], 'o'
+mov byte [162], 'k'
+
+mov di, 320
+mov ax, 0x072d
+mov cx, 10
+rep stosw
+
+mov si, 0
+mov di, 3840
+movsw
+movsw
@@ -0,0 +1,32 @@
+; segment registers, overrides, the ss default for bp, string ops across segments, and the CGA
+; buffer at B800:0000
+bits 16
+
+mov ax, 0x100
+mov ds, ax
+mov word [0], 0x1234
+mov ax, 0x80
+mov es, ax
+mov cx, [es:0x800]
+push ds
+pop es
+mov dx, es
+
+mov ax, 0x50
+mov ss, ax
+mov sp, 0x100
+push dx
+mov bp, sp
+mov si, [bp]
+mov di, [ds:bp]
+
+xor si, si
+mov di, 2
+movsw
+mov bx, [2]
+
+mov ax, 0xb800
+mov es, ax
+mov word [es:0], 0x0748
+mov word [es:2], 0x0769
+mov ax, [es:0]
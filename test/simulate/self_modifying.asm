@@ -0,0 +1,23 @@
+bits 16
+
+; the block at body runs once, then gets its first nop pair rewritten into a jump to done
+mov cx, 2
+jmp body
+
+body:
+	inc bx
+	nop
+	nop
+	jmp patch
+
+patch:
+	mov word [body + 1], 0x12eb ; jmp done, from body + 3
+	dec cx
+	jnz body
+
+mov dx, 1
+mov dx, 2
+nop
+
+done:
+mov ax, 5
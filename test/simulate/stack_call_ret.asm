@@ -0,0 +1,34 @@
+bits 16
+
+mov sp, 1024
+mov ax, 5
+call double
+push ax
+pop bx
+mov cx, 3
+call count_down
+mov word [12], int_handler
+mov word [14], 0
+int3
+jmp done
+
+double:
+	push cx
+	mov cx, ax
+	add ax, cx
+	pop cx
+	ret
+
+count_down:
+	sub cx, 1
+	jnz recurse
+	ret
+recurse:
+	call count_down
+	ret
+
+int_handler:
+	mov dx, 7
+	iret
+
+done:
@@ -0,0 +1,32 @@
+bits 16
+
+mov ax, 0x4142
+mov di, 256
+mov cx, 4
+rep stosw
+
+mov si, 256
+mov di, 512
+mov cx, 8
+rep movsb
+
+; overlapping forward copy smears [256] across the run
+mov si, 256
+mov di, 257
+mov cx, 7
+rep movsb
+
+mov di, 512
+mov al, 0x41
+mov cx, 8
+repne scasb
+
+std
+mov si, 519
+lodsb
+cld
+
+mov si, 256
+mov di, 512
+mov cx, 8
+repe cmpsb